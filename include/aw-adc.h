@@ -0,0 +1,89 @@
+#pragma once
+
+namespace AW {
+
+class TActorLib;
+
+// background ADC sampler, scans the configured pins round-robin from the ADC interrupt
+// every channel accumulates sum and count of samples, so actors could take the average without blocking,
+// a sink could be attached to a channel to get every sample right in the interrupt (RMS, zero crossing...)
+// on SAMD the ADC averages 2^Oversampling conversions in hardware, on AVR it's done in software,
+// on other platforms (and on host) samples are taken by Poll()
+// the running sampler owns the ADC and its interrupt (ADC_Handler / ADC_vect): analogRead() and TAnalogPin
+// would take its results, use AnalogRead() instead, and a sketch with its own ADC interrupt handler is built
+// with -DAW_NO_ADC_INTERRUPT, then the samples are taken by Poll() as on the other platforms
+// the ADC stops in the standby (SAMD runs it from GCLK0 without RUNSTDBY, AVR power-down), so the sensors start
+// the sampler by Begin(lib), which holds a StandbyLock of the lib until End()
+class TADCSampler {
+public:
+    using TSink = void (*)(void* context, uint16_t value);
+    static constexpr uint8_t MaxChannels = 6;
+
+    struct TChannel {
+        uint8_t Pin = 0;
+        TSink Sink = nullptr;
+        void* SinkContext = nullptr;
+        volatile uint32_t Sum = 0;
+        volatile uint16_t Count = 0;
+        volatile uint16_t Last = 0;
+    };
+
+    // returns index of the channel or -1, the running sampler is restarted with the new channel
+    static int8_t AddChannel(uint8_t pin, TSink sink = nullptr, void* context = nullptr);
+    static void Begin(uint8_t oversampling = 4);
+    // starts the sampler if it isn't running yet and keeps the lib out of the standby while it runs
+    static void Begin(TActorLib& lib, uint8_t oversampling = 4);
+    static void End();
+
+    static bool IsRunning() {
+        return Running;
+    }
+
+    static uint8_t GetFreeChannels() {
+        return MaxChannels - ChannelCount;
+    }
+
+    // returns number of samples and their sum accumulated since the last call
+    static uint16_t Take(uint8_t channel, uint32_t& sum);
+    static uint16_t GetLast(uint8_t channel);
+
+    // total number of results, for the rate measurement
+    static uint32_t GetSamples() {
+        return Samples;
+    }
+
+    static uint8_t GetOversampling() {
+        return Oversampling;
+    }
+
+    // maximum value of one result
+    static constexpr uint16_t GetMaxValue() {
+        return ArduinoSettings::GetReadResolution() - 1;
+    }
+
+    // takes one result for every channel synchronously, used where there is no ADC interrupt
+    static void Poll();
+
+    // analogRead() of a pin which is not a channel, the sampler is stopped for the conversion
+    static uint16_t AnalogRead(uint8_t pin);
+
+    // called from the ADC interrupt
+    static void OnSample(uint16_t value);
+
+protected:
+    static TChannel Channels[MaxChannels];
+    static uint8_t ChannelCount;
+    static volatile uint8_t Current;
+    static volatile bool Running;
+    static volatile uint32_t Samples;
+    static uint8_t Oversampling;
+    static TActorLib* StandbyLib; // holding the lock
+
+    // stops the conversions, keeps the lock, for the restarts
+    static void Stop();
+    static void StartConversion(uint8_t channel);
+    static void SetupPin(uint8_t pin);
+    static uint16_t ReadSoftware(uint8_t pin);
+};
+
+}
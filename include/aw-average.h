@@ -117,5 +117,350 @@ protected:
     Type Accumulator;
 };
 
+// accumulator types for the streaming aggregators, integer types and fixed3_t are summed in wider integers,
+// so there is no float and no truncation on every sample
+template <typename Type>
+struct TAverageTraits {
+    using AccumulatorType = Type;
+
+    static AccumulatorType ToAccumulator(Type value) { return value; }
+    static Type FromAccumulator(AccumulatorType value) { return value; }
+    static Type FromSquare(AccumulatorType value) { return value; }
+    static Type Divide(AccumulatorType sum, long count) { return sum / count; }
+    static bool Less(Type a, Type b) { return a < b; }
+};
+
+template <typename Type, typename WideType>
+struct TIntegerAverageTraits {
+    using AccumulatorType = WideType;
+
+    static AccumulatorType ToAccumulator(Type value) { return value; }
+    static Type FromAccumulator(AccumulatorType value) { return (Type)value; }
+    static Type FromSquare(AccumulatorType value) { return (Type)value; }
+
+    static Type Divide(AccumulatorType sum, long count) {
+        return (Type)((sum < 0 ? sum - count / 2 : sum + count / 2) / count);
+    }
+
+    static bool Less(Type a, Type b) { return a < b; }
+};
+
+template <> struct TAverageTraits<int> : TIntegerAverageTraits<int, int64_t> {};
+template <> struct TAverageTraits<long> : TIntegerAverageTraits<long, int64_t> {};
+template <> struct TAverageTraits<unsigned int> : TIntegerAverageTraits<unsigned int, uint64_t> {};
+template <> struct TAverageTraits<unsigned long> : TIntegerAverageTraits<unsigned long, uint64_t> {};
+
+template <>
+struct TAverageTraits<fixed3_t> {
+    using AccumulatorType = int64_t;
+
+    static AccumulatorType ToAccumulator(fixed3_t value) { return value.raw(); }
+
+    static fixed3_t FromAccumulator(AccumulatorType value) {
+        fixed3_t result;
+        result.raw((int32_t)value);
+        return result;
+    }
+
+    static fixed3_t Divide(AccumulatorType sum, long count) {
+        return FromAccumulator((sum < 0 ? sum - count / 2 : sum + count / 2) / count);
+    }
+
+    // raw values are in 1/1000, so the square is in 1/1000000
+    static fixed3_t FromSquare(AccumulatorType value) {
+        return Divide(value, 1000);
+    }
+
+    static bool Less(fixed3_t a, fixed3_t b) { return a.raw() < b.raw(); }
+};
+
+// exact mean of the last WindowSize values
+template <typename Type, int WindowSize = 60>
+class TMovingAverage {
+public:
+    using TTraits = TAverageTraits<Type>;
+
+    void AddValue(Type value) {
+        if (Count == WindowSize) {
+            Accumulator -= TTraits::ToAccumulator(Values[Position]);
+        } else {
+            ++Count;
+        }
+        Values[Position] = value;
+        Accumulator += TTraits::ToAccumulator(value);
+        Position = (Position + 1) % WindowSize;
+    }
+
+    void SetValue(Type value) {
+        Clear();
+        AddValue(value);
+    }
+
+    Type GetValue() const {
+        return Count == 0 ? Type() : TTraits::Divide(Accumulator, Count);
+    }
+
+    int GetCount() const {
+        return Count;
+    }
+
+    void Clear() {
+        Accumulator = typename TTraits::AccumulatorType();
+        Count = 0;
+        Position = 0;
+    }
+
+    bool IsValid(int samples = 1) const {
+        return GetCount() >= samples;
+    }
+
+    void operator =(Type value) {
+        AddValue(value);
+    }
+
+    operator Type() const {
+        return GetValue();
+    }
+
+protected:
+    Type Values[WindowSize];
+    typename TTraits::AccumulatorType Accumulator = typename TTraits::AccumulatorType();
+    int Count = 0;
+    int Position = 0;
+};
+
+// exponentially weighted moving average with weight 1/2^Shift,
+// the state keeps Shift extra bits, so small changes are not lost on integers
+template <typename Type, int Shift = 4>
+class TExponentialAverage {
+public:
+    using TTraits = TAverageTraits<Type>;
+    using AccumulatorType = typename TTraits::AccumulatorType;
+    static constexpr long Factor = 1L << Shift;
+
+    void AddValue(Type value) {
+        if (Count == 0) {
+            State = TTraits::ToAccumulator(value) * Factor;
+        } else {
+            State += TTraits::ToAccumulator(value) - TTraits::ToAccumulator(GetValue());
+        }
+        if (Count < Factor) {
+            ++Count;
+        }
+    }
+
+    void SetValue(Type value) {
+        Clear();
+        AddValue(value);
+    }
+
+    Type GetValue() const {
+        return TTraits::Divide(State, Factor);
+    }
+
+    int GetCount() const {
+        return Count;
+    }
+
+    void Clear() {
+        State = AccumulatorType();
+        Count = 0;
+    }
+
+    bool IsValid(int samples = 1) const {
+        return GetCount() >= samples;
+    }
+
+    void operator =(Type value) {
+        AddValue(value);
+    }
+
+    operator Type() const {
+        return GetValue();
+    }
+
+protected:
+    AccumulatorType State = AccumulatorType();
+    int Count = 0;
+};
+
+// minimum (or maximum) of the last WindowSize values, monotonic deque of candidates
+template <typename Type, int WindowSize = 60, bool Maximum = false>
+class TMovingExtremum {
+public:
+    using TTraits = TAverageTraits<Type>;
+
+    void AddValue(Type value) {
+        while (Size > 0 && !Better(Values[Back()], value)) {
+            --Size;
+        }
+        if (Size > 0 && Indexes[Front] + WindowSize <= Index) {
+            Front = (Front + 1) % WindowSize;
+            --Size;
+        }
+        uint8_t back = (Front + Size) % WindowSize;
+        Values[back] = value;
+        Indexes[back] = Index;
+        ++Size;
+        ++Index;
+        if (Count < WindowSize) {
+            ++Count;
+        }
+    }
+
+    void SetValue(Type value) {
+        Clear();
+        AddValue(value);
+    }
+
+    Type GetValue() const {
+        return Size == 0 ? Type() : Values[Front];
+    }
+
+    int GetCount() const {
+        return Count;
+    }
+
+    void Clear() {
+        Front = 0;
+        Size = 0;
+        Count = 0;
+    }
+
+    bool IsValid(int samples = 1) const {
+        return GetCount() >= samples;
+    }
+
+    void operator =(Type value) {
+        AddValue(value);
+    }
+
+    operator Type() const {
+        return GetValue();
+    }
+
+protected:
+    static_assert(WindowSize <= 255, "window is too big");
+    Type Values[WindowSize];
+    unsigned long Indexes[WindowSize];
+    unsigned long Index = 0;
+    uint8_t Front = 0;
+    uint8_t Size = 0;
+    int Count = 0;
+
+    static bool Better(Type a, Type b) {
+        return Maximum ? TTraits::Less(b, a) : TTraits::Less(a, b);
+    }
+
+    uint8_t Back() const {
+        return (Front + Size - 1) % WindowSize;
+    }
+};
+
+template <typename Type, int WindowSize = 60>
+using TMovingMinimum = TMovingExtremum<Type, WindowSize, false>;
+
+template <typename Type, int WindowSize = 60>
+using TMovingMaximum = TMovingExtremum<Type, WindowSize, true>;
+
+// median of the last WindowSize values, robust to single outliers (spikes, dropped echoes...)
+// the window is sorted on GetValue(), so it's meant for small windows
+template <typename Type, int WindowSize = 5>
+class TMovingMedian {
+public:
+    using TTraits = TAverageTraits<Type>;
+
+    void AddValue(Type value) {
+        Values[Position] = value;
+        Position = (Position + 1) % WindowSize;
+        if (Count < WindowSize) {
+            ++Count;
+        }
+    }
+
+    void SetValue(Type value) {
+        Clear();
+        AddValue(value);
+    }
+
+    // the lower median for even count
+    Type GetValue() const {
+        if (Count == 0) {
+            return Type();
+        }
+        Type sorted[WindowSize];
+        for (int i = 0; i < Count; ++i) {
+            Type value = Values[i];
+            int j = i;
+            for (; j > 0 && TTraits::Less(value, sorted[j - 1]); --j) {
+                sorted[j] = sorted[j - 1];
+            }
+            sorted[j] = value;
+        }
+        return sorted[(Count - 1) / 2];
+    }
+
+    int GetCount() const {
+        return Count;
+    }
+
+    void Clear() {
+        Count = 0;
+        Position = 0;
+    }
+
+    bool IsValid(int samples = 1) const {
+        return GetCount() >= samples;
+    }
+
+    void operator =(Type value) {
+        AddValue(value);
+    }
+
+    operator Type() const {
+        return GetValue();
+    }
+
+protected:
+    Type Values[WindowSize];
+    int Count = 0;
+    int Position = 0;
+};
+
+// variance of the last WindowSize values, summed over the window when it's asked for,
+// as the deviations from the mean, so the squares don't grow with the values (pressure in Pa as fixed3)
+// GetValue() returns the mean, GetVariance() is in squared units of the Type
+template <typename Type, int WindowSize = 60>
+class TMovingVariance : public TMovingAverage<Type, WindowSize> {
+public:
+    using TBase = TMovingAverage<Type, WindowSize>;
+    using TTraits = typename TBase::TTraits;
+    using AccumulatorType = typename TTraits::AccumulatorType;
+
+    AccumulatorType GetRawVariance() const {
+        int count = TBase::Count;
+        if (count < 2) {
+            return AccumulatorType();
+        }
+        AccumulatorType mean = TBase::Accumulator / count;
+        AccumulatorType sum = AccumulatorType();
+        AccumulatorType squares = AccumulatorType();
+        for (int i = 0; i < count; ++i) {
+            AccumulatorType deviation = TTraits::ToAccumulator(TBase::Values[i]) - mean;
+            sum += deviation;
+            squares += deviation * deviation;
+        }
+        // the mean is rounded, the rest of it is in the sum of the deviations
+        return (squares - sum * sum / count) / count;
+    }
+
+    Type GetVariance() const {
+        return TTraits::FromSquare(GetRawVariance());
+    }
+
+    void operator =(Type value) {
+        TBase::AddValue(value);
+    }
+};
 
 }
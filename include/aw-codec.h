@@ -0,0 +1,263 @@
+#pragma once
+
+namespace AW {
+
+// compact encoding of (time, fixed3_t) series
+// block = uint16 count + samples, every sample is zigzag varint of delta-of-delta of the time
+// and zigzag varint of delta of the raw value, so a slow sensor with a fixed period costs 2 bytes per sample
+// series are interleaved in one block by id, every id keeps its own deltas
+
+inline uint32_t ZigZagEncode(int32_t value) {
+    return ((uint32_t)value << 1) ^ (uint32_t)(value >> 31);
+}
+
+inline int32_t ZigZagDecode(uint32_t value) {
+    return (int32_t)(value >> 1) ^ -(int32_t)(value & 1);
+}
+
+class TByteWriter {
+public:
+    TByteWriter(uint8_t* data, size_t capacity)
+        : Data(data)
+        , Capacity(capacity)
+    {}
+
+    void Write(uint8_t value) {
+        if (Size < Capacity) {
+            Data[Size] = value;
+        } else {
+            Overflow = true;
+        }
+        ++Size;
+    }
+
+    void WriteVarInt(uint32_t value) {
+        while (value >= 0x80) {
+            Write((uint8_t)(value | 0x80));
+            value >>= 7;
+        }
+        Write((uint8_t)value);
+    }
+
+    void WriteUInt16(size_t pos, uint16_t value) {
+        if (pos + 2 <= Capacity) {
+            Data[pos] = (uint8_t)value;
+            Data[pos + 1] = (uint8_t)(value >> 8);
+        }
+    }
+
+    size_t size() const {
+        return Size;
+    }
+
+    bool IsOverflow() const {
+        return Overflow;
+    }
+
+    void Rollback(size_t size) {
+        Size = size;
+        Overflow = Size > Capacity;
+    }
+
+protected:
+    uint8_t* Data;
+    size_t Capacity;
+    size_t Size = 0;
+    bool Overflow = false;
+};
+
+class TByteReader {
+public:
+    TByteReader(const uint8_t* data, size_t size)
+        : Data(data)
+        , Size(size)
+    {}
+
+    bool Read(uint8_t& value) {
+        if (Position < Size) {
+            value = Data[Position++];
+            return true;
+        }
+        return false;
+    }
+
+    bool ReadVarInt(uint32_t& value) {
+        value = 0;
+        for (uint8_t shift = 0; shift < 35; shift += 7) {
+            uint8_t byte;
+            if (!Read(byte)) {
+                return false;
+            }
+            value |= (uint32_t)(byte & 0x7f) << shift;
+            if ((byte & 0x80) == 0) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    bool ReadUInt16(uint16_t& value) {
+        uint8_t low, high;
+        if (Read(low) && Read(high)) {
+            value = low | ((uint16_t)high << 8);
+            return true;
+        }
+        return false;
+    }
+
+protected:
+    const uint8_t* Data;
+    size_t Size;
+    size_t Position = 0;
+};
+
+struct TSeriesState {
+    uint16_t Id = 0;
+    uint32_t Time = 0;
+    int32_t TimeDelta = 0;
+    int32_t Value = 0;
+};
+
+// sample = varint (series index << 1 | new series flag) [, varint id], zigzag dod time, zigzag delta value
+// the series table lives only inside one block, so every block could be decoded alone
+template <uint8_t MaxSeries = 8>
+class TSeriesEncoder {
+public:
+    static constexpr size_t HeaderSize = 2;
+
+    TSeriesEncoder(uint8_t* data, size_t capacity)
+        : Writer(data, capacity)
+    {
+        Writer.Write(0);
+        Writer.Write(0);
+    }
+
+    // false when the sample doesn't fit, the block stays valid
+    bool Append(uint32_t time, fixed3_t value, uint16_t id = 0) {
+        size_t rollback = Writer.size();
+        uint8_t index = Find(id);
+        if (index < Series) {
+            Writer.WriteVarInt((uint32_t)index << 1);
+        } else if (Series < MaxSeries) {
+            Writer.WriteVarInt(((uint32_t)index << 1) | 1);
+            Writer.WriteVarInt(id);
+        } else {
+            return false;
+        }
+        TSeriesState& state(States[index]);
+        // the deltas are wrapped in uint32_t, a signed overflow is UB, the decoder wraps them back the same way
+        int32_t timeDelta = (int32_t)(time - state.Time);
+        Writer.WriteVarInt(ZigZagEncode((int32_t)((uint32_t)timeDelta - (uint32_t)state.TimeDelta)));
+        Writer.WriteVarInt(ZigZagEncode((int32_t)((uint32_t)value.raw() - (uint32_t)state.Value)));
+        if (Writer.IsOverflow() || Count == 0xffff) {
+            Writer.Rollback(rollback);
+            return false;
+        }
+        if (index == Series) {
+            States[index] = TSeriesState();
+            States[index].Id = id;
+            ++Series;
+        }
+        state.Time = time;
+        state.TimeDelta = timeDelta;
+        state.Value = value.raw();
+        ++Count;
+        return true;
+    }
+
+    // writes the header, returns size of the block
+    size_t Finish() {
+        Writer.WriteUInt16(0, Count);
+        return Writer.size();
+    }
+
+    uint16_t GetCount() const {
+        return Count;
+    }
+
+    size_t size() const {
+        return Writer.size();
+    }
+
+protected:
+    TByteWriter Writer;
+    TSeriesState States[MaxSeries];
+    uint8_t Series = 0;
+    uint16_t Count = 0;
+
+    uint8_t Find(uint16_t id) const {
+        for (uint8_t i = 0; i < Series; ++i) {
+            if (States[i].Id == id) {
+                return i;
+            }
+        }
+        return Series;
+    }
+};
+
+template <uint8_t MaxSeries = 8>
+class TSeriesDecoder {
+public:
+    TSeriesDecoder(const uint8_t* data, size_t size)
+        : Reader(data, size)
+    {
+        if (!Reader.ReadUInt16(Count)) {
+            Count = 0;
+        }
+    }
+
+    uint16_t GetCount() const {
+        return Count;
+    }
+
+    bool Next(uint32_t& time, fixed3_t& value, uint16_t& id) {
+        if (Count == 0) {
+            return false;
+        }
+        uint32_t index;
+        if (!Reader.ReadVarInt(index)) {
+            return false;
+        }
+        bool isNew = (index & 1) != 0;
+        index >>= 1;
+        if (index >= MaxSeries || index > Series || (isNew != (index == Series))) {
+            return false;
+        }
+        if (isNew) {
+            uint32_t newId;
+            if (!Reader.ReadVarInt(newId)) {
+                return false;
+            }
+            States[index] = TSeriesState();
+            States[index].Id = (uint16_t)newId;
+            ++Series;
+        }
+        TSeriesState& state(States[index]);
+        uint32_t dod;
+        uint32_t delta;
+        if (!Reader.ReadVarInt(dod) || !Reader.ReadVarInt(delta)) {
+            return false;
+        }
+        state.TimeDelta = (int32_t)((uint32_t)state.TimeDelta + (uint32_t)ZigZagDecode(dod));
+        state.Time += state.TimeDelta;
+        state.Value = (int32_t)((uint32_t)state.Value + (uint32_t)ZigZagDecode(delta));
+        time = state.Time;
+        value.raw(state.Value);
+        id = state.Id;
+        --Count;
+        return true;
+    }
+
+    bool Next(uint32_t& time, fixed3_t& value) {
+        uint16_t id;
+        return Next(time, value, id);
+    }
+
+protected:
+    TByteReader Reader;
+    TSeriesState States[MaxSeries];
+    uint8_t Series = 0;
+    uint16_t Count = 0;
+};
+
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+#include "aw-string-buf.h"
+
+namespace AW {
+
+// FNV-1a of the command verb, constexpr to be used as a case label: switch (command.Hash) { case CommandHash("PING"): ... }
+// two known verbs with the same hash are duplicate case labels, but any other line could still hash the same,
+// so each case compares command.Verb with its verb before acting
+constexpr uint32_t CommandHash(const char* verb, String::size_type size, uint32_t hash = 2166136261u) {
+    return size == 0 ? hash : CommandHash(verb + 1, size - 1, (hash ^ (uint8_t)*verb) * 16777619u);
+}
+
+template <String::size_type N>
+constexpr uint32_t CommandHash(const char(&verb)[N]) {
+    return CommandHash(verb, N - 1);
+}
+
+inline uint32_t CommandHash(StringBuf verb) {
+    uint32_t hash = 2166136261u;
+    for (char c : verb) {
+        hash = (hash ^ (uint8_t)c) * 16777619u;
+    }
+    return hash;
+}
+
+// command line split by spaces to the verb and up to MaxArgs arguments, the tokens are views into the line
+class TCommand {
+public:
+    static constexpr uint8_t MaxArgs = 4;
+
+    StringBuf Line;
+    StringBuf Verb;
+    StringBuf Tail; // everything after the verb
+    StringBuf Args[MaxArgs];
+    uint8_t ArgCount = 0;
+    uint32_t Hash;
+
+    explicit TCommand(StringBuf line)
+        : Line(line)
+    {
+        Verb = line.NextToken(' ');
+        Tail = line;
+        while (!line.empty() && ArgCount < MaxArgs) {
+            Args[ArgCount++] = line.NextToken(' ');
+        }
+        Hash = CommandHash(Verb);
+    }
+
+    // empty if there is no such argument
+    StringBuf GetArg(uint8_t index) const {
+        return index < ArgCount ? Args[index] : StringBuf();
+    }
+};
+
+}
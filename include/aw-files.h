@@ -2,8 +2,31 @@
 
 namespace AW {
 
+// interface of the file system for the actors which shouldn't depend on its byte array type
+class IFileSystem {
+public:
+    virtual bool WriteFile(StringBuf name, StringBuf data) = 0;
+    virtual bool ReadFile(StringBuf name, String& data) = 0;
+    virtual bool EraseFile(StringBuf name) = 0;
+
+    template <typename Type>
+    bool WriteValue(StringBuf name, Type value) {
+        return WriteFile(name, String(value));
+    }
+
+    template <typename Type>
+    Type ReadValue(StringBuf name, Type defaultValue = Type()) {
+        String value;
+        if (ReadFile(name, value)) {
+            return value;
+        } else {
+            return defaultValue;
+        }
+    }
+};
+
 template <typename TByteArray>
-class TFileSystem {
+class TFileSystem : public IFileSystem {
 protected:
     TByteArray& ByteArray;
 
@@ -166,7 +189,7 @@ public:
         return iterator(ByteArray, ByteArray.length());
     }
 
-    bool WriteFile(StringBuf name, StringBuf data) {
+    bool WriteFile(StringBuf name, StringBuf data) override {
         auto nameSize = name.size();
         auto dataSize = data.size();
         if (nameSize > MAXIMUM_DATA_SIZE) {
@@ -205,7 +228,7 @@ public:
         return false;
     }
 
-    bool ReadFile(StringBuf name, String& data) {
+    bool ReadFile(StringBuf name, String& data) override {
         for (auto it = begin(); it < end(); ++it) {
             if (it.GetName() == name) { // TODO: optimize
                 data = it.GetData();
@@ -215,7 +238,7 @@ public:
         return false;
     }
 
-    bool EraseFile(StringBuf name) {
+    bool EraseFile(StringBuf name) override {
         for (iterator it = begin(); it < end();) {
             if (it.GetName() == name) {
                 it.Erase();
@@ -227,21 +250,6 @@ public:
         return false;
     }
 
-    template <typename Type>
-    bool WriteValue(StringBuf name, Type value) {
-        return WriteFile(name, String(value));
-    }
-
-    template <typename Type>
-    Type ReadValue(StringBuf name, Type defaultValue = Type()) {
-        String value;
-        if (ReadFile(name, value)) {
-            return value;
-        } else {
-            return defaultValue;
-        }
-    }
-
     void Defrag() {
         for (auto current = begin(); current < end(); ++current) {
             if (current.IsFree()) {
@@ -1,124 +1,391 @@
 #pragma once
 
+// note: this file is included inside of namespace AW
+
+constexpr int32_t FixedPow10(int points) {
+    return points == 0 ? 1 : 10 * FixedPow10(points - 1);
+}
+
+// the NaN marker is out of the saturated range, so no result of the arithmetic could be taken for it
+constexpr int32_t FixedNaN = -0x7fffffffL - 1;
+
+constexpr int32_t FixedSaturate(int64_t value) {
+    return value > 0x7fffffffLL ? 0x7fffffffL : value < -0x7fffffffLL ? -0x7fffffffL : (int32_t)value;
+}
+
+constexpr int32_t FixedSaturate(double value) {
+    return value != value ? FixedNaN : value > 2147483647.0 ? 0x7fffffffL : value < -2147483647.0 ? -0x7fffffffL : (int32_t)value;
+}
+
+// division by a constant through multiplication by reciprocal, m = ceil(2^s / D) with the smallest s
+// which is exact for any 32-bit dividend, wider values fall back to the real division
+constexpr uint64_t FixedMagic(uint32_t divider, int shift) {
+    return ((1ULL << shift) + divider - 1) / divider;
+}
+
+constexpr bool FixedMagicIsExact(uint32_t divider, int shift) {
+    return FixedMagic(divider, shift) < (1ULL << 32) && (FixedMagic(divider, shift) * divider - (1ULL << shift)) <= (1ULL << (shift - 32));
+}
+
+constexpr int FixedMagicShift(uint32_t divider, int shift = 32) {
+    return shift > 63 ? 0 : FixedMagicIsExact(divider, shift) ? shift : FixedMagicShift(divider, shift + 1);
+}
+
+// integer square root, floor(sqrt(value))
+inline uint32_t ISqrt(uint64_t value) {
+    uint64_t result = 0;
+    uint64_t bit = (uint64_t)1 << 62;
+    while (bit > value) {
+        bit >>= 2;
+    }
+    while (bit != 0) {
+        if (value >= result + bit) {
+            value -= result + bit;
+            result = (result >> 1) + bit;
+        } else {
+            result >>= 1;
+        }
+        bit >>= 2;
+    }
+    return (uint32_t)result;
+}
+
+template <uint32_t D>
+struct TDivideByConstant {
+    static constexpr int Shift = FixedMagicShift(D);
+    static constexpr uint64_t Multiplier = Shift == 0 ? 0 : FixedMagic(D, Shift);
+
+    static uint32_t Divide(uint32_t value) {
+        return Shift == 0 ? value / D : (uint32_t)((value * Multiplier) >> Shift);
+    }
+
+    // rounds half away from zero
+    static int64_t DivideRound(int64_t value) {
+        uint64_t magnitude = value < 0 ? -(uint64_t)value : (uint64_t)value;
+        magnitude += D / 2;
+        magnitude = magnitude <= 0xffffffffULL ? Divide((uint32_t)magnitude) : magnitude / D;
+        return value < 0 ? -(int64_t)magnitude : (int64_t)magnitude;
+    }
+};
+
+template <uint32_t D>
+constexpr int TDivideByConstant<D>::Shift;
+
+template <uint32_t D>
+constexpr uint64_t TDivideByConstant<D>::Multiplier;
+
 template <int points>
 struct TFixedPointConstants {
+    static constexpr int32_t MULTIPLIER = FixedPow10(points);
+    static constexpr int32_t NOT_A_NUMBER = FixedNaN;
+    static constexpr int32_t MAX = 0x7fffffff;
+    static constexpr int32_t MIN = -0x7fffffff;
 };
 
-template <>
-struct TFixedPointConstants<3> {
-    static constexpr int32_t MULTIPLIER = 1000;
-    static constexpr int32_t NOT_A_NUMBER = 0x10000000;
-    struct NOT_A_NUMBER_MARKER {};
-};
+template <int points>
+constexpr int32_t TFixedPointConstants<points>::MULTIPLIER;
 
+template <int points>
+constexpr int32_t TFixedPointConstants<points>::NOT_A_NUMBER;
+
+// decimal fixed point value, raw Value is the number of 1/10^points
+// all intermediate results are 64-bit, results are rounded and saturated to int32,
+// division by zero gives NOT_A_NUMBER, and any operation on NOT_A_NUMBER gives it back
 template <int points = 3>
 struct TFixedPointValue {
-    static constexpr TFixedPointValue NOT_A_NUMBER = { TFixedPointConstants<points>::NOT_A_NUMBER_MARKER() };
+    using TConstants = TFixedPointConstants<points>;
+    using TDivider = TDivideByConstant<TConstants::MULTIPLIER>;
     int32_t Value;
 
-    bool operator ==(TFixedPointValue<points> other) const {
-        return Value == other.Value;
+    constexpr TFixedPointValue()
+        : Value()
+    {}
+
+    constexpr TFixedPointValue(int other)
+        : Value(FixedSaturate((int64_t)other * TConstants::MULTIPLIER))
+    {}
+
+    constexpr TFixedPointValue(unsigned int other)
+        : Value(FixedSaturate((int64_t)other * TConstants::MULTIPLIER))
+    {}
+
+    constexpr TFixedPointValue(long other)
+        : Value(FixedSaturate((int64_t)other * TConstants::MULTIPLIER))
+    {}
+
+    constexpr TFixedPointValue(unsigned long other)
+        : Value(FixedSaturate((int64_t)other * TConstants::MULTIPLIER))
+    {}
+
+    constexpr TFixedPointValue(long long other)
+        : Value(FixedSaturate(other > 0x7fffffffLL || other < -0x7fffffffLL ? other : other * TConstants::MULTIPLIER))
+    {}
+
+    // conversion from float truncates, as the conversion to int does
+    constexpr TFixedPointValue(float other)
+        : Value(FixedSaturate((double)other * TConstants::MULTIPLIER))
+    {}
+
+    constexpr TFixedPointValue(double other)
+        : Value(FixedSaturate(other * TConstants::MULTIPLIER))
+    {}
+
+    static constexpr TFixedPointValue FromRaw(int32_t value) {
+        return TFixedPointValue(value, TRawTag());
     }
 
-    bool operator !=(TFixedPointValue<points> other) const {
-        return Value != other.Value;
+    // value / 10^p, e.g. FromDecimal(12345, 2) is 123.45
+    static TFixedPointValue FromDecimal(int64_t value, int p) {
+        return p == points ? FromRaw(FixedSaturate(value)) : p < points ? FromRaw(FixedSaturate(value * FixedPow10(points - p))) : FromRaw(FixedSaturate(RoundDivide(value, FixedPow10(p - points))));
+    }
+
+    bool operator ==(TFixedPointValue other) const { return Value == other.Value; }
+    bool operator !=(TFixedPointValue other) const { return Value != other.Value; }
+    bool operator <(TFixedPointValue other) const { return Value < other.Value; }
+    bool operator <=(TFixedPointValue other) const { return Value <= other.Value; }
+    bool operator >(TFixedPointValue other) const { return Value > other.Value; }
+    bool operator >=(TFixedPointValue other) const { return Value >= other.Value; }
+
+    TFixedPointValue operator -() const {
+        return isnan() ? *this : FromRaw(-Value);
+    }
+
+    TFixedPointValue operator +(TFixedPointValue value) const {
+        if (isnan() || value.isnan()) {
+            return FromRaw(TConstants::NOT_A_NUMBER);
+        }
+        return FromRaw(FixedSaturate((int64_t)Value + value.Value));
+    }
+
+    TFixedPointValue operator -(TFixedPointValue value) const {
+        if (isnan() || value.isnan()) {
+            return FromRaw(TConstants::NOT_A_NUMBER);
+        }
+        return FromRaw(FixedSaturate((int64_t)Value - value.Value));
+    }
+
+    TFixedPointValue operator *(TFixedPointValue value) const {
+        if (isnan() || value.isnan()) {
+            return FromRaw(TConstants::NOT_A_NUMBER);
+        }
+        return FromRaw(FixedSaturate(TDivider::DivideRound((int64_t)Value * value.Value)));
     }
 
     TFixedPointValue operator /(TFixedPointValue value) const {
-        TFixedPointValue n;
-        n.Value = Value * TFixedPointConstants<points>::MULTIPLIER / value.Value;
-        return n;
+        if (isnan() || value.isnan() || value.Value == 0) {
+            return FromRaw(TConstants::NOT_A_NUMBER);
+        }
+        return FromRaw(FixedSaturate(RoundDivide((int64_t)Value * TConstants::MULTIPLIER, value.Value)));
     }
 
-    TFixedPointValue& operator /=(TFixedPointValue value) {
-        Value = Value * TFixedPointConstants<points>::MULTIPLIER / value.Value;
-        return *this;
+    // integer scale, no conversion of the argument to fixed point
+    TFixedPointValue Multiply(int64_t value) const {
+        if (isnan()) {
+            return *this;
+        }
+        return FromRaw(FixedSaturate((int64_t)Value * value));
     }
 
-    TFixedPointValue operator +(TFixedPointValue value) const {
-        TFixedPointValue n;
-        n.Value = Value + value.Value;
-        return n;
+    TFixedPointValue Divide(int64_t value) const {
+        if (isnan() || value == 0) {
+            return FromRaw(TConstants::NOT_A_NUMBER);
+        }
+        return FromRaw(FixedSaturate(RoundDivide(Value, value)));
     }
 
-    TFixedPointValue& operator +=(TFixedPointValue value) {
-        Value += value.Value;
-        return *this;
+    // float scale is done in double, converting the argument to fixed point first would lose small factors
+    TFixedPointValue Multiply(double value) const {
+        if (isnan()) {
+            return *this;
+        }
+        return FromRaw(FixedSaturate(Round((double)Value * value)));
     }
 
-    TFixedPointValue()
-        : Value()
+    TFixedPointValue Divide(double value) const {
+        if (isnan() || value == 0) {
+            return FromRaw(TConstants::NOT_A_NUMBER);
+        }
+        return FromRaw(FixedSaturate(Round((double)Value / value)));
+    }
+
+    TFixedPointValue operator *(int value) const { return Multiply((int64_t)value); }
+    TFixedPointValue operator *(unsigned int value) const { return Multiply((int64_t)value); }
+    TFixedPointValue operator *(long value) const { return Multiply((int64_t)value); }
+    TFixedPointValue operator *(unsigned long value) const { return Multiply((int64_t)value); }
+    TFixedPointValue operator *(float value) const { return Multiply((double)value); }
+    TFixedPointValue operator *(double value) const { return Multiply(value); }
+    TFixedPointValue operator /(int value) const { return Divide((int64_t)value); }
+    TFixedPointValue operator /(unsigned int value) const { return Divide((int64_t)value); }
+    TFixedPointValue operator /(long value) const { return Divide((int64_t)value); }
+    TFixedPointValue operator /(unsigned long value) const { return Divide((int64_t)value); }
+    TFixedPointValue operator /(float value) const { return Divide((double)value); }
+    TFixedPointValue operator /(double value) const { return Divide(value); }
+
+    template <typename Type>
+    TFixedPointValue& operator +=(Type value) { return *this = *this + value; }
+
+    template <typename Type>
+    TFixedPointValue& operator -=(Type value) { return *this = *this - value; }
+
+    template <typename Type>
+    TFixedPointValue& operator *=(Type value) { return *this = *this * value; }
+
+    template <typename Type>
+    TFixedPointValue& operator /=(Type value) { return *this = *this / value; }
+
+    // the same value in other precision, e.g. fixed3_t -> TFixedPointValue<1>
+    template <int other>
+    TFixedPointValue<other> Convert() const {
+        return TFixedPointValue<other>::FromDecimal(Value, points);
+    }
+
+    // rounded to the nearest integer, half away from zero
+    int32_t ToInt() const {
+        return (int32_t)TDivider::DivideRound(Value);
+    }
+
+    float ToFloat() const {
+        return (float)Value / TConstants::MULTIPLIER;
+    }
+
+    explicit operator float() const {
+        return ToFloat();
+    }
+
+    explicit operator double() const {
+        return (double)Value / TConstants::MULTIPLIER;
+    }
+
+    bool isnan() const {
+        return Value == TConstants::NOT_A_NUMBER;
+    }
+
+    void setnan() {
+        Value = TConstants::NOT_A_NUMBER;
+    }
+
+    constexpr int32_t raw() const {
+        return Value;
+    }
+
+    void raw(int32_t v) {
+        Value = v;
+    }
+
+    static int64_t RoundDivide(int64_t value, int64_t divider) {
+        if (divider < 0) {
+            value = -value;
+            divider = -divider;
+        }
+        return (value < 0 ? value - divider / 2 : value + divider / 2) / divider;
+    }
+
+    // half away from zero, NaN stays NaN for FixedSaturate
+    static double Round(double value) {
+        return value < 0 ? value - 0.5 : value + 0.5;
+    }
+
+protected:
+    struct TRawTag {};
+
+    constexpr TFixedPointValue(int32_t value, TRawTag)
+        : Value(value)
     {}
+};
+
+using fixed3_t = TFixedPointValue<3>;
 
-    TFixedPointValue(unsigned long other)
-        : Value(other * TFixedPointConstants<points>::MULTIPLIER)
+// binary fixed point value (Q-format), raw Value is the number of 1/2^bits,
+// cheaper than decimal for multiplication chains, e.g. filters and calibration
+template <int bits = 16>
+struct TQValue {
+    static constexpr int32_t ONE = 1L << bits;
+    int32_t Value;
+
+    constexpr TQValue()
+        : Value()
     {}
 
-    TFixedPointValue(int other)
-        : Value(other * TFixedPointConstants<points>::MULTIPLIER)
+    constexpr TQValue(int other)
+        : Value(FixedSaturate((int64_t)other << bits))
     {}
 
-    TFixedPointValue(int32_t other)
-        : Value(other * TFixedPointConstants<points>::MULTIPLIER)
+    constexpr TQValue(long other)
+        : Value(FixedSaturate((int64_t)other << bits))
     {}
 
-    TFixedPointValue(int64_t other)
-        : Value(other * TFixedPointConstants<points>::MULTIPLIER)
+    constexpr TQValue(float other)
+        : Value(FixedSaturate((double)other * ONE))
     {}
 
-    constexpr TFixedPointValue(float other)
-        : Value(other * TFixedPointConstants<points>::MULTIPLIER)
+    constexpr TQValue(double other)
+        : Value(FixedSaturate(other * ONE))
     {}
 
-    constexpr TFixedPointValue(double other)
-        : Value(other * TFixedPointConstants<points>::MULTIPLIER)
+    template <int points>
+    TQValue(TFixedPointValue<points> other)
+        : Value(FixedSaturate(TFixedPointValue<points>::RoundDivide((int64_t)other.raw() << bits, TFixedPointConstants<points>::MULTIPLIER)))
     {}
 
-    TFixedPointValue& operator =(unsigned long other) {
-        Value = other * TFixedPointConstants<points>::MULTIPLIER;
-        return *this;
+    static constexpr TQValue FromRaw(int32_t value) {
+        return TQValue(value, TRawTag());
     }
 
-    TFixedPointValue& operator =(int other) {
-        Value = other * TFixedPointConstants<points>::MULTIPLIER;
-        return *this;
-    }
+    bool operator ==(TQValue other) const { return Value == other.Value; }
+    bool operator !=(TQValue other) const { return Value != other.Value; }
+    bool operator <(TQValue other) const { return Value < other.Value; }
+    bool operator <=(TQValue other) const { return Value <= other.Value; }
+    bool operator >(TQValue other) const { return Value > other.Value; }
+    bool operator >=(TQValue other) const { return Value >= other.Value; }
 
-    TFixedPointValue& operator =(int32_t other) {
-        Value = other * TFixedPointConstants<points>::MULTIPLIER;
-        return *this;
+    TQValue operator -() const {
+        return FromRaw(-Value);
     }
 
-    TFixedPointValue& operator =(int64_t other) {
-        Value = other * TFixedPointConstants<points>::MULTIPLIER;
-        return *this;
+    TQValue operator +(TQValue value) const {
+        return FromRaw(FixedSaturate((int64_t)Value + value.Value));
     }
 
-    TFixedPointValue& operator =(float other) {
-        Value = other * TFixedPointConstants<points>::MULTIPLIER;
-        return *this;
+    TQValue operator -(TQValue value) const {
+        return FromRaw(FixedSaturate((int64_t)Value - value.Value));
     }
 
-    TFixedPointValue& operator =(double other) {
-        Value = other * TFixedPointConstants<points>::MULTIPLIER;
-        return *this;
+    TQValue operator *(TQValue value) const {
+        return FromRaw(FixedSaturate(((int64_t)Value * value.Value + (ONE >> 1)) >> bits));
     }
 
-    bool isnan() const {
-        return Value == TFixedPointConstants<points>::NOT_A_NUMBER;
+    TQValue operator /(TQValue value) const {
+        if (value.Value == 0) {
+            return FromRaw(Value < 0 ? -0x7fffffffL : 0x7fffffffL);
+        }
+        return FromRaw(FixedSaturate(TFixedPointValue<0>::RoundDivide((int64_t)Value << bits, value.Value)));
     }
 
-    void setnan() {
-        Value = TFixedPointConstants<points>::NOT_A_NUMBER;
+    TQValue& operator +=(TQValue value) { return *this = *this + value; }
+    TQValue& operator -=(TQValue value) { return *this = *this - value; }
+    TQValue& operator *=(TQValue value) { return *this = *this * value; }
+    TQValue& operator /=(TQValue value) { return *this = *this / value; }
+
+    template <int points>
+    TFixedPointValue<points> ToFixed() const {
+        return TFixedPointValue<points>::FromRaw(FixedSaturate(((int64_t)Value * TFixedPointConstants<points>::MULTIPLIER + (ONE >> 1)) >> bits));
     }
 
-    int32_t raw() const {
+    constexpr int32_t raw() const {
         return Value;
     }
 
     void raw(int32_t v) {
         Value = v;
     }
+
+protected:
+    struct TRawTag {};
+
+    constexpr TQValue(int32_t value, TRawTag)
+        : Value(value)
+    {}
 };
 
-using fixed3_t = TFixedPointValue<3>;
+template <int bits>
+constexpr int32_t TQValue<bits>::ONE;
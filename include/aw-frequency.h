@@ -0,0 +1,39 @@
+#pragma once
+
+namespace AW {
+
+// rising edge counter for high-rate pulse inputs (flow meters, tachometers) without CPU work per edge:
+// on SAMD the EXTINT line of the pin is routed through an EVSYS channel to the count event of a 16-bit TC,
+// the count is extended to 32 bits in software, so Read() has to be called at least every 65535 edges,
+// on AVR the edges are counted in the pin interrupt (TPinInterrupts), which limits the rate to a few tens of kHz,
+// on other platforms (host) the edges are simulated from SimulatedFrequency
+class TFrequencyCounter {
+public:
+    uint32_t SimulatedFrequency = 0; // Hz
+
+    // timer is the TC index (3..5 on SAMD21), channel is the EVSYS channel, both have to be free
+    TFrequencyCounter(uint8_t pin, uint8_t timer = 3, uint8_t channel = 0)
+        : Pin(pin)
+        , Timer(timer)
+        , Channel(channel)
+    {}
+
+    bool Begin();
+    void End();
+
+    // total number of edges since Begin()
+    uint32_t Read();
+
+protected:
+    uint8_t Pin;
+    uint8_t Timer;
+    uint8_t Channel;
+    uint16_t LastCount = 0;
+    volatile uint32_t Total = 0;
+    uint32_t LastTime = 0;
+    uint32_t SimulatedRemainder = 0;
+
+    static void OnEdge(void* context);
+};
+
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+namespace AW {
+
+// dispatch table of pin interrupts, so a driver could have any number of instances:
+// attachInterrupt() takes a plain function without arguments, every slot of the table has its own trampoline
+// which calls the handler of the slot with its context (usually the driver instance)
+class TPinInterrupts {
+public:
+    using THandler = void (*)(void* context);
+    static constexpr uint8_t MaxSlots = 8;
+
+    // mode is the one of attachInterrupt() (RISING, FALLING, CHANGE), returns false if the table is full
+    // with wakeUp the interrupt also wakes the MCU from the sleep of TActorLib (SAMD only: the EIC is clocked
+    // from the 32 kHz ULP oscillator then, to detect edges in standby, so it can't be used with TFrequencyCounter)
+    static bool Attach(uint8_t pin, int mode, THandler handler, void* context, bool wakeUp = false);
+    static void Detach(uint8_t pin);
+
+protected:
+    struct TSlot {
+        uint8_t Pin = 0;
+        THandler Handler = nullptr;
+        void* Context = nullptr;
+    };
+
+    static TSlot Slots[MaxSlots];
+
+    // slot of the pin, or the first free one, or -1
+    static int8_t FindSlot(uint8_t pin);
+    static void EnableWakeUp(uint8_t pin);
+
+    template <uint8_t Index>
+    static void Trampoline() {
+        Slots[Index].Handler(Slots[Index].Context);
+    }
+
+    static void (* const Trampolines[MaxSlots])();
+};
+
+}
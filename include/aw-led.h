@@ -18,7 +18,8 @@ struct TEventLedBlink : TBasicEvent<TEventLedBlink> {
         : Period(period) {}
 };
 
-class TLedActor : public TActor {
+class TLedActor : public THandles<TLedActor, TEventLedOn, TEventLedOff, TEventLedBlink, TEventReceive> {
+    friend THandles;
 protected:
     TDigitalPin<LED_BUILTIN> LedPin;
     bool Led = false;
@@ -26,37 +27,22 @@ protected:
     TLedActor()
     {}
 
-    void OnEvent(TEventPtr event, const TActorContext& context) override {
-        switch (event->EventID) {
-        case TEventLedOn::EventID:
-            return OnLedOn(static_cast<TEventLedOn*>(event.Release()), context);
-        case TEventLedOff::EventID:
-            return OnLedOff(static_cast<TEventLedOff*>(event.Release()), context);
-        case TEventLedBlink::EventID:
-            return OnLedBlink(static_cast<TEventLedBlink*>(event.Release()), context);
-        case TEventReceive::EventID:
-            return OnReceive(static_cast<TEventReceive*>(event.Release()), context);
-        default:
-            break;
-        }
-    }
-
-    void OnLedOn(TUniquePtr<TEventLedOn>, const TActorContext&) {
+    void Handle(TUniquePtr<TEventLedOn>, const TActorContext&) {
         LedPin = Led = true;
     }
 
-    void OnLedOff(TUniquePtr<TEventLedOff>, const TActorContext&) {
+    void Handle(TUniquePtr<TEventLedOff>, const TActorContext&) {
         LedPin = Led = false;
     }
 
-    void OnLedBlink(TUniquePtr<TEventLedBlink> event, const TActorContext& context) {
+    void Handle(TUniquePtr<TEventLedBlink> event, const TActorContext& context) {
         if (!Led) {
             context.Send(this, this, new TEventReceive());
             context.Send(this, this, new TEventReceive(context.Now + event->Period));
         }
     }
 
-    void OnReceive(TUniquePtr<TEventReceive> /*event*/, const TActorContext& /*context*/) {
+    void Handle(TUniquePtr<TEventReceive> /*event*/, const TActorContext& /*context*/) {
         LedPin = Led = !Led;
     }
 };
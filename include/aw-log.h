@@ -0,0 +1,178 @@
+#pragma once
+#include <stddef.h>
+#include <string.h>
+
+namespace AW {
+
+// one logged sample, Id is crc16 of "source.value" (the same CRC which is used for DATA lines)
+// Time is in seconds of the log clock, which continues from the last record after a reset
+struct TLogRecord {
+    uint16_t Sequence;
+    uint16_t Id;
+    uint32_t Time;
+    int32_t Value;
+    uint16_t Crc;
+
+    uint16_t GetCrc() const {
+        return StringBuf(reinterpret_cast<const char*>(this), offsetof(TLogRecord, Crc)).crc16();
+    }
+
+    fixed3_t GetValue() const {
+        fixed3_t value;
+        value.raw(Value);
+        return value;
+    }
+};
+
+// circular log of TLogRecord on top of a byte array (EEPROM, flash, cached array...)
+// the newest record is found on start by the break in the sequence numbers, so there is no header to rewrite
+template <typename TByteArray>
+class TDataLog {
+public:
+    static constexpr size_t RecordSize = sizeof(TLogRecord);
+
+    TDataLog(TByteArray& array)
+        : ByteArray(array)
+    {
+        Mount();
+    }
+
+    static uint16_t GetId(StringBuf source, StringBuf value) {
+        return value.crc16(StringBuf(".").crc16(source.crc16()));
+    }
+
+    size_t capacity() const {
+        return ByteArray.length() / RecordSize;
+    }
+
+    size_t size() const {
+        return Count;
+    }
+
+    bool empty() const {
+        return Count == 0;
+    }
+
+    uint32_t GetTime(TTime now) const {
+        return Base + now.Seconds();
+    }
+
+    // sequence of the next appended record
+    uint16_t GetSequence() const {
+        return Sequence;
+    }
+
+    void Append(TTime now, uint16_t id, fixed3_t value) {
+        TLogRecord record;
+        // the padding goes to the storage too
+        memset(&record, 0, sizeof(record));
+        record.Sequence = Sequence++;
+        record.Id = id;
+        record.Time = GetTime(now);
+        record.Value = value.raw();
+        record.Crc = record.GetCrc();
+        WriteRecord(Head, record);
+        Head = (Head + 1) % capacity();
+        if (Count < capacity()) {
+            ++Count;
+        }
+    }
+
+    void Append(TTime now, StringBuf source, StringBuf value, fixed3_t data) {
+        Append(now, GetId(source, value), data);
+    }
+
+    // index 0 is the oldest record
+    bool Read(size_t index, TLogRecord& record) {
+        if (index >= Count) {
+            return false;
+        }
+        ReadRecord((Head + capacity() - Count + index) % capacity(), record);
+        return record.Crc == record.GetCrc();
+    }
+
+    // index of the first record with Time >= since, size() if there are none
+    // a damaged record is taken as an older one
+    size_t Find(uint32_t since) {
+        size_t begin = 0;
+        size_t end = Count;
+        while (begin < end) {
+            size_t middle = begin + (end - begin) / 2;
+            TLogRecord record;
+            if (!Read(middle, record) || record.Time < since) {
+                begin = middle + 1;
+            } else {
+                end = middle;
+            }
+        }
+        return begin;
+    }
+
+    void Clear() {
+        Count = 0;
+    }
+
+    void Sync() {
+        ByteArray.Sync();
+    }
+
+protected:
+    TByteArray& ByteArray;
+    size_t Head = 0;
+    size_t Count = 0;
+    uint16_t Sequence = 0;
+    uint32_t Base = 0;
+
+    void ReadRecord(size_t slot, TLogRecord& record) {
+        uint8_t* data = reinterpret_cast<uint8_t*>(&record);
+        size_t offset = slot * RecordSize;
+        for (size_t i = 0; i < RecordSize; ++i) {
+            data[i] = ByteArray.read(offset + i);
+        }
+    }
+
+    void WriteRecord(size_t slot, const TLogRecord& record) {
+        const uint8_t* data = reinterpret_cast<const uint8_t*>(&record);
+        size_t offset = slot * RecordSize;
+        for (size_t i = 0; i < RecordSize; ++i) {
+            ByteArray.write(offset + i, data[i]);
+        }
+    }
+
+    bool ReadValidRecord(size_t slot, TLogRecord& record) {
+        ReadRecord(slot, record);
+        return record.Crc == record.GetCrc();
+    }
+
+    void Mount() {
+        size_t slots = capacity();
+        TLogRecord record;
+        TLogRecord next;
+        bool valid = slots > 0 && ReadValidRecord(0, record);
+        for (size_t slot = 0; slot < slots; ++slot) {
+            bool nextValid = ReadValidRecord((slot + 1) % slots, next);
+            if (valid && (!nextValid || next.Sequence != (uint16_t)(record.Sequence + 1))) {
+                Head = (slot + 1) % slots;
+                Count = nextValid ? slots : slot + 1;
+                Sequence = record.Sequence + 1;
+                Base = record.Time + 1;
+                return;
+            }
+            record = next;
+            valid = nextValid;
+        }
+    }
+};
+
+// used when there is no log configured
+struct TNoDataLog {
+    static constexpr size_t size() { return 0; }
+    static bool Read(size_t, TLogRecord&) { return false; }
+    static size_t Find(uint32_t) { return 0; }
+    static uint32_t GetTime(TTime) { return 0; }
+    static uint16_t GetSequence() { return 0; }
+    static void Append(TTime, StringBuf, StringBuf, fixed3_t) {}
+    static void Sync() {}
+};
+
+}
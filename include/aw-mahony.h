@@ -0,0 +1,105 @@
+#pragma once
+
+namespace AW {
+
+// 6-axis Mahony filter (gyroscope + accelerometer) in fixed point, one Update() per IMU sample
+// the orientation quaternion is Q30, rotations are given as the angle turned during one sample (radians, Q30),
+// the accelerometer may be in any units, only its direction is used
+// without a magnetometer the yaw is the integrated gyroscope, so it drifts slowly
+class TMahonyFilter {
+public:
+    static constexpr int32_t One = (int32_t)1 << 30;
+
+    // per-sample gains in Q30, Kp / rate and Ki / rate^2
+    int32_t ProportionalGain;
+    int32_t IntegralGain;
+
+    // kp and ki are the usual Mahony gains (1/s and 1/s^2)
+    TMahonyFilter(float kp, float ki, uint16_t sampleRate)
+        : ProportionalGain((int32_t)(kp * One / sampleRate))
+        , IntegralGain((int32_t)(ki * One / sampleRate / sampleRate))
+    {}
+
+    void Reset() {
+        Q[0] = One;
+        Q[1] = Q[2] = Q[3] = 0;
+        Integral[0] = Integral[1] = Integral[2] = 0;
+    }
+
+    // g is the rotation during the sample (radians, Q30), a is the raw acceleration
+    void Update(int32_t gx, int32_t gy, int32_t gz, int32_t ax, int32_t ay, int32_t az) {
+        uint32_t norm = ISqrt((uint64_t)((int64_t)ax * ax + (int64_t)ay * ay + (int64_t)az * az));
+        if (norm != 0) {
+            ax = (int32_t)(((int64_t)ax << 30) / norm);
+            ay = (int32_t)(((int64_t)ay << 30) / norm);
+            az = (int32_t)(((int64_t)az << 30) / norm);
+            // direction of gravity according to the current orientation
+            int32_t vx = (int32_t)(((int64_t)Q[1] * Q[3] - (int64_t)Q[0] * Q[2]) >> 29);
+            int32_t vy = (int32_t)(((int64_t)Q[0] * Q[1] + (int64_t)Q[2] * Q[3]) >> 29);
+            int32_t vz = (int32_t)(((int64_t)Q[0] * Q[0] - (int64_t)Q[1] * Q[1] - (int64_t)Q[2] * Q[2] + (int64_t)Q[3] * Q[3]) >> 30);
+            // the error is the rotation between the measured and the estimated directions
+            int32_t ex = Multiply(ay, vz) - Multiply(az, vy);
+            int32_t ey = Multiply(az, vx) - Multiply(ax, vz);
+            int32_t ez = Multiply(ax, vy) - Multiply(ay, vx);
+            if (IntegralGain != 0) {
+                Integral[0] += Multiply(ex, IntegralGain);
+                Integral[1] += Multiply(ey, IntegralGain);
+                Integral[2] += Multiply(ez, IntegralGain);
+                gx += Integral[0];
+                gy += Integral[1];
+                gz += Integral[2];
+            }
+            gx += Multiply(ex, ProportionalGain);
+            gy += Multiply(ey, ProportionalGain);
+            gz += Multiply(ez, ProportionalGain);
+        }
+        // q += q * (0, g) / 2
+        int32_t q0 = Q[0];
+        int32_t q1 = Q[1];
+        int32_t q2 = Q[2];
+        int32_t q3 = Q[3];
+        Q[0] += (-Multiply(q1, gx) - Multiply(q2, gy) - Multiply(q3, gz)) / 2;
+        Q[1] += (Multiply(q0, gx) + Multiply(q2, gz) - Multiply(q3, gy)) / 2;
+        Q[2] += (Multiply(q0, gy) - Multiply(q1, gz) + Multiply(q3, gx)) / 2;
+        Q[3] += (Multiply(q0, gz) + Multiply(q1, gy) - Multiply(q2, gx)) / 2;
+        Normalize();
+    }
+
+    int32_t GetQuaternion(uint8_t index) const {
+        return Q[index];
+    }
+
+    // Tait-Bryan angles in degrees, float is fine here as they are taken only for the reports
+    void GetAngles(float& roll, float& pitch, float& yaw) const {
+        float q0 = (float)Q[0] / One;
+        float q1 = (float)Q[1] / One;
+        float q2 = (float)Q[2] / One;
+        float q3 = (float)Q[3] / One;
+        float sinPitch = 2 * (q0 * q2 - q3 * q1);
+        sinPitch = sinPitch > 1 ? 1 : sinPitch < -1 ? -1 : sinPitch;
+        roll = atan2f(q0 * q1 + q2 * q3, 0.5f - q1 * q1 - q2 * q2) * RAD_TO_DEG;
+        pitch = asinf(sinPitch) * RAD_TO_DEG;
+        yaw = atan2f(q0 * q3 + q1 * q2, 0.5f - q2 * q2 - q3 * q3) * RAD_TO_DEG;
+    }
+
+protected:
+    int32_t Q[4] = {One, 0, 0, 0};
+    int32_t Integral[3] = {};
+
+    static int32_t Multiply(int32_t a, int32_t b) {
+        return (int32_t)(((int64_t)a * b) >> 30);
+    }
+
+    void Normalize() {
+        uint32_t norm = ISqrt((uint64_t)((int64_t)Q[0] * Q[0] + (int64_t)Q[1] * Q[1] + (int64_t)Q[2] * Q[2] + (int64_t)Q[3] * Q[3]));
+        if (norm == 0) {
+            Reset();
+            return;
+        }
+        for (uint8_t i = 0; i < 4; ++i) {
+            Q[i] = (int32_t)(((int64_t)Q[i] << 30) / norm);
+        }
+    }
+};
+
+}
@@ -0,0 +1,280 @@
+#pragma once
+
+namespace AW {
+
+// DC offset tracker (single-pole IIR, the high-pass part) and positive-going zero crossing detector of an AC signal
+class TZeroCrossing {
+public:
+    // time constant of the offset filter is 2^OffsetShift samples
+    static constexpr uint8_t OffsetShift = 10;
+    // crossing is detected only when the signal leaves +-Hysteresis band, to ignore noise around zero
+    static constexpr int16_t Hysteresis = 4;
+
+    explicit TZeroCrossing(uint16_t maxValue)
+        : Offset((int32_t)(maxValue / 2) << 16)
+    {}
+
+    // returns true on the positive-going crossing
+    bool Add(uint16_t value) {
+        Offset += (((int32_t)value << 16) - Offset) / (1 << OffsetShift);
+        int32_t sample = (int32_t)value - GetOffset();
+        if (sample > Hysteresis) {
+            if (!Positive) {
+                Positive = true;
+                return true;
+            }
+        } else if (sample < -Hysteresis) {
+            Positive = false;
+        }
+        return false;
+    }
+
+    // current DC offset in ADC units
+    int16_t GetOffset() const {
+        return (int16_t)(Offset >> 16);
+    }
+
+protected:
+    int32_t Offset;
+    bool Positive = false;
+};
+
+// streaming RMS of an AC signal, fed sample by sample (usually as TADCSampler sink, right in the interrupt)
+// the window starts and ends on the positive-going zero crossing, so it always covers whole mains cycles,
+// without crossings (no load, DC) the window is closed after MaxSamples
+// the sums are taken relative to the offset at the window start and the window mean is removed at the end,
+// so the ripple of the offset filter doesn't leak into the result
+class TRMSAccumulator {
+public:
+    uint8_t Cycles;
+    uint32_t MaxSamples;
+
+    TRMSAccumulator(uint16_t maxValue, uint8_t cycles = 10, uint32_t maxSamples = 50000)
+        : Cycles(cycles)
+        , MaxSamples(maxSamples)
+        , Crossing(maxValue)
+        , Base(Crossing.GetOffset())
+    {}
+
+    static void OnSample(void* context, uint16_t value) {
+        static_cast<TRMSAccumulator*>(context)->Add(value);
+    }
+
+    void Add(uint16_t value) {
+        if (Crossing.Add(value)) {
+            if (Crossings >= Cycles) {
+                Publish();
+            }
+            if (Crossings == 0) {
+                // the first crossing starts the aligned window, everything before is dropped
+                Start();
+            }
+            ++Crossings;
+        }
+        int32_t delta = (int32_t)value - Base;
+        Sum += delta;
+        SumSquares += (uint32_t)(delta * delta);
+        ++Count;
+        if (Count >= MaxSamples) {
+            Publish();
+            Start();
+        }
+    }
+
+    // returns true and the RMS (in ADC units, Q8) of the last complete window, if there was a new one
+    bool Take(uint32_t& rms) {
+        noInterrupts();
+        int32_t sum = ResultSum;
+        uint64_t squares = ResultSumSquares;
+        uint32_t count = ResultCount;
+        ResultCount = 0;
+        interrupts();
+        if (count == 0) {
+            return false;
+        }
+        rms = GetRMS(sum, squares, count);
+        return true;
+    }
+
+    uint16_t GetOffset() const {
+        return Crossing.GetOffset();
+    }
+
+    // RMS (Q8) of the samples without their mean, N * variance = sum(x^2) - sum(x)^2 / N
+    static uint32_t GetRMS(int32_t sum, uint64_t squares, uint32_t count) {
+        uint64_t variance = squares - (uint64_t)((int64_t)sum * sum / count);
+        return ISqrt((variance << 16) / count);
+    }
+
+protected:
+    TZeroCrossing Crossing;
+    int16_t Base;
+    int32_t Sum = 0;
+    uint64_t SumSquares = 0;
+    uint32_t Count = 0;
+    uint8_t Crossings = 0;
+    volatile int32_t ResultSum = 0;
+    volatile uint64_t ResultSumSquares = 0;
+    volatile uint32_t ResultCount = 0;
+
+    void Publish() {
+        ResultSum = Sum;
+        ResultSumSquares = SumSquares;
+        ResultCount = Count;
+        Crossings = 0;
+    }
+
+    void Start() {
+        Base = Crossing.GetOffset();
+        Sum = 0;
+        SumSquares = 0;
+        Count = 0;
+    }
+};
+
+// real power of a voltage / current pair, V and I are consecutive TADCSampler channels (V first),
+// every I sample is multiplied by the V sample interpolated to the same moment:
+// V' = Vprev + PhaseCalibration * (V - Vprev), PhaseCalibration is Q8 (256 = the last V sample, as EmonLib's PHASECAL 1.0)
+// the windows are aligned to the voltage zero crossings, Vrms / Irms / mean(V*I) of the last window are kept for the report,
+// mean(V*I) of all windows since the last Take() is kept for the energy integration
+class TPowerAccumulator {
+public:
+    struct TResult {
+        uint32_t VoltageRMS; // ADC units, Q8
+        uint32_t CurrentRMS; // ADC units, Q8
+        int64_t Power; // mean(V*I) of the last window, ADC units^2, Q8
+        int64_t AveragePower; // mean(V*I) since the last Take(), ADC units^2, Q8
+    };
+
+    uint8_t Cycles;
+    uint32_t MaxSamples;
+    int16_t PhaseCalibration;
+
+    TPowerAccumulator(uint16_t maxValue, int16_t phaseCalibration = 256, uint8_t cycles = 10, uint32_t maxSamples = 50000)
+        : Cycles(cycles)
+        , MaxSamples(maxSamples)
+        , PhaseCalibration(phaseCalibration)
+        , VoltageCrossing(maxValue)
+        , VoltageBase(VoltageCrossing.GetOffset())
+        , CurrentBase((int16_t)(maxValue / 2))
+        , CurrentOffset(maxValue)
+    {}
+
+    static void OnVoltage(void* context, uint16_t value) {
+        static_cast<TPowerAccumulator*>(context)->AddVoltage(value);
+    }
+
+    static void OnCurrent(void* context, uint16_t value) {
+        static_cast<TPowerAccumulator*>(context)->AddCurrent(value);
+    }
+
+    void AddVoltage(uint16_t value) {
+        if (VoltageCrossing.Add(value)) {
+            if (Crossings >= Cycles) {
+                Publish();
+            }
+            if (Crossings == 0) {
+                Start();
+            }
+            ++Crossings;
+        }
+        LastVoltage = Voltage;
+        Voltage = (int32_t)value - VoltageBase;
+    }
+
+    void AddCurrent(uint16_t value) {
+        CurrentOffset.Add(value);
+        int32_t voltage = LastVoltage + ((PhaseCalibration * (Voltage - LastVoltage)) >> 8);
+        int32_t current = (int32_t)value - CurrentBase;
+        SumV += voltage;
+        SumI += current;
+        SumVV += (uint32_t)(voltage * voltage);
+        SumII += (uint32_t)(current * current);
+        SumVI += voltage * current;
+        ++Count;
+        if (Count >= MaxSamples) {
+            Publish();
+            Start();
+        }
+    }
+
+    // returns false if there was no complete window since the last call
+    bool Take(TResult& result) {
+        noInterrupts();
+        TWindow window = Result;
+        int64_t totalPower = TotalPower;
+        uint32_t totalCount = TotalCount;
+        Result.Count = 0;
+        TotalPower = 0;
+        TotalCount = 0;
+        interrupts();
+        if (window.Count == 0 || totalCount == 0) {
+            return false;
+        }
+        result.VoltageRMS = TRMSAccumulator::GetRMS(window.SumV, window.SumVV, window.Count);
+        result.CurrentRMS = TRMSAccumulator::GetRMS(window.SumI, window.SumII, window.Count);
+        result.Power = window.GetPower() * 256 / window.Count;
+        result.AveragePower = totalPower * 256 / totalCount;
+        return true;
+    }
+
+protected:
+    struct TWindow {
+        int32_t SumV;
+        int32_t SumI;
+        uint64_t SumVV;
+        uint64_t SumII;
+        int64_t SumVI;
+        uint32_t Count;
+
+        // N * covariance = sum(v*i) - sum(v) * sum(i) / N
+        int64_t GetPower() const {
+            return SumVI - (int64_t)SumV * SumI / (int64_t)Count;
+        }
+    };
+
+    TZeroCrossing VoltageCrossing;
+    int16_t VoltageBase;
+    int16_t CurrentBase;
+    // current offset is tracked only to move the base of the next window
+    TZeroCrossing CurrentOffset;
+    int32_t Voltage = 0;
+    int32_t LastVoltage = 0;
+    int32_t SumV = 0;
+    int32_t SumI = 0;
+    uint64_t SumVV = 0;
+    uint64_t SumII = 0;
+    int64_t SumVI = 0;
+    uint32_t Count = 0;
+    uint8_t Crossings = 0;
+    TWindow Result = {};
+    volatile int64_t TotalPower = 0;
+    volatile uint32_t TotalCount = 0;
+
+    void Publish() {
+        if (Count == 0) {
+            return;
+        }
+        Result = {SumV, SumI, SumVV, SumII, SumVI, Count};
+        TotalPower += Result.GetPower();
+        TotalCount += Count;
+        Crossings = 0;
+    }
+
+    void Start() {
+        int16_t base = VoltageCrossing.GetOffset();
+        // the interpolation keeps working across the window boundary
+        Voltage += VoltageBase - base;
+        LastVoltage += VoltageBase - base;
+        VoltageBase = base;
+        CurrentBase = CurrentOffset.GetOffset();
+        SumV = 0;
+        SumI = 0;
+        SumVV = 0;
+        SumII = 0;
+        SumVI = 0;
+        Count = 0;
+    }
+};
+
+}
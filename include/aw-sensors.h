@@ -6,6 +6,7 @@
 #include "aw-average.h"
 #include "aw-string-buf.h"
 #include "aw-time.h"
+#include "aw-command.h"
 
 extern Uart ConsoleSerial;
 
@@ -178,11 +179,12 @@ using TSensorValueFixed3 = TSensorValue<TOptionalValueBase<fixed3_t>>;
 using TSensorValueFloat = TSensorValue<TOptionalValueBase<float>>;
 using TSensorValueULong = TSensorValue<TOptionalValueBase<unsigned long>>;
 
-template <typename ValueType, int WindowsSize = 60>
+// AverageType could be any of TAverage, TMovingAverage, TExponentialAverage, TMovingMinimum, TMovingMaximum...
+template <typename ValueType, int WindowsSize = 60, typename AverageType = TAverage<ValueType, WindowsSize>>
 struct TAveragedSensorValue : TSensorValue<TOptionalValueBase<ValueType>> {
 public:
     using TBase = TSensorValue<TOptionalValueBase<ValueType>>;
-    TAverage<ValueType, WindowsSize> Average;
+    AverageType Average;
 
     void operator =(ValueType value) {
         Average.AddValue(value);
@@ -241,6 +243,15 @@ struct TEventSensorMessage : TBasicEvent<TEventSensorMessage> {
         , Message(message) {}
 };
 
+// next batch of the running DUMP, the events of the older dumps are dropped by the generation
+struct TEventSensorDump : TBasicEvent<TEventSensorDump> {
+    constexpr static TEventID EventID = TEventID::EventPrivate9;
+    uint8_t Generation;
+
+    TEventSensorDump(uint8_t generation)
+        : Generation(generation) {}
+};
+
 template <typename Env = TDefaultEnvironment, bool HaveConsole = Env::HaveConsole>
 class TConsoleActor;
 
@@ -276,6 +287,14 @@ public:
     TTime Period = DefaultPeriod;
     TEventReceive* EventReceive;
     TTime LastReportTime;
+    TTime LastLogTime;
+    bool Logging = false;
+    // the dump continues after the last sent record (its time and sequence), the indexes move when the log wraps
+    uint32_t DumpTime = 0;
+    uint16_t DumpSequence = 0;
+    uint8_t DumpGeneration = 0;
+    bool DumpPacked = false;
+    typename Env::DataLog* DataLog = nullptr;
     TTime ConnectAliveTime;
     TSensorSource TimeSource;
     TSensorValueULong TimeTotal;
@@ -306,6 +325,8 @@ public:
             return SensorSensorData(static_cast<TEventSensorData*>(event.Release()), context);
         case TEventSensorMessage::EventID:
             return SensorSensorMessage(static_cast<TEventSensorMessage*>(event.Release()), context);
+        case TEventSensorDump::EventID:
+            return SensorDump(static_cast<TEventSensorDump*>(event.Release()), context);
         default:
             break;
         }
@@ -325,11 +346,25 @@ public:
     virtual void OnSensorData(TUniquePtr<TEventSensorData>, const TActorContext&) {}
     virtual void OnReceive(const TActorContext&) {}
 
-    virtual bool OnCommand(const AW::String&, const AW::TActorContext&) {
+    // commands of the derived actor, dispatched by switch (command.Hash) with CommandHash("VERB") labels,
+    // each case checks command.Verb == "VERB" first, the hash alone can collide
+    virtual bool OnCommand(const TCommand&, const TActorContext&) {
+        return false;
+    }
+
+    // legacy handler of the whole line, called only if the TCommand one didn't take it
+    virtual bool OnCommand(StringBuf, const TActorContext&) {
         return false;
     }
 
+    // adds the commands of the derived actor to the HELP listing, one line each
+    virtual void OnHelp(TActor*, const TActorContext&) {}
+
     virtual void OnSendSensors(const TActorContext& context) {
+        if (Logging) {
+            // milliseconds don't fit into the fixed3 of the log after 35 minutes
+            return;
+        }
         TimeSource.Updated = context.Now;
         TimeTotal.Value.SetValue(context.Now.MilliSeconds());
         TimeBusy.Value.SetValue(context.ActorLib.BusyTime.MilliSeconds());
@@ -353,6 +388,9 @@ public:
                 context.Send(this, &Console, new TEventSleep());
             }
             context.Send(this, &Channel, new TEventSleep());
+            if (DataLog != nullptr) {
+                DataLog->Sync();
+            }
             context.ActorLib.Sleep();
             PowerBluetooth = false;
             SleepLED = true;
@@ -409,59 +447,123 @@ public:
         while (!data.empty() && (data[0] <= 32 || data[0] > 127)) {
             data = data.substr(1);
         }
-        if (OnCommand(data, context)) {
+        TCommand command(data);
+        if (OnCommand(command, context) || OnCommand(data, context)) {
             // do nothing
-        } else if (data == "OK") {
-            // do nothing
-        } else if (data == "PING") {
-            context.Send(this, event->Sender, new TEventData("PONG"));
         } else if (data.ends_with("CONNECTED") || data.starts_with("+")) {
             Feed = false;
             Period = TTime::Seconds(30);
             Channel.PurgeEvents(TEventData::EventID);
-        } else if (data.starts_with("FEED")) {
+            Channel.PurgeTransmit();
+        } else if (!SensorCommand(command, event->Sender, context)) {
+            context.Send(this, event->Sender, new TEventData(StringStream() << "WRONG " << data));
+        }
+        if (Env::HaveConsole && event->Sender != &Console) {
+            context.Send(this, &Console, event.Release());
+        }
+        Led = false;
+    }
+
+    static const char* const* GetCommandsHelp() {
+        static const char* const help[] = {
+            "PING",
+            "READ",
+            "FEED [seconds]",
+            "STOP",
+            "SLEEP seconds",
+            "DUMP [since=time] [packed]",
+            "RESET [reason]",
+            "HELP",
+            nullptr,
+        };
+        return help;
+    }
+
+    bool SensorCommand(const TCommand& command, TActor* sender, const TActorContext& context) {
+        // the hash only selects the candidate, an unknown verb with the same hash must not run it
+        switch (command.Hash) {
+        case CommandHash("OK"):
+            if (command.Verb != "OK") {
+                break;
+            }
+            return true;
+        case CommandHash("PING"):
+            if (command.Verb != "PING") {
+                break;
+            }
+            context.Send(this, sender, new TEventData("PONG"));
+            return true;
+        case CommandHash("FEED"):
+            if (command.Verb != "FEED") {
+                break;
+            }
             Feed = true;
-            if (data.size() > 4) {
-                Period = TTime::Seconds(event->Data.substr(5));
+            if (command.ArgCount != 0) {
+                Period = TTime::Seconds(command.Args[0]);
             } else {
                 Period = DefaultPeriod;
             }
             EventReceive->NotBefore = context.Now/* + Period*/;
-        } else if (Env::SupportsSleep && data.starts_with("SLEEP")) {
-            if (data.size() > 5) {
-                TTime period = TTime::Seconds(data.substr(6));
+            EventsChanged = true; // the queued event is moved, the lib's scan of the queue is stale
+            return true;
+        case CommandHash("SLEEP"):
+            if (command.Verb != "SLEEP") {
+                break;
+            }
+            if (!Env::SupportsSleep) {
+                return false;
+            }
+            if (command.ArgCount != 0) {
+                TTime period = TTime::Seconds(command.Args[0]);
                 context.Send(this, this, new TEventSleep());
                 context.Send(this, this, new TEventWakeUp(context.Now + period));
                 Feed = false;
                 Period = DefaultPeriod;
             }
-        } else if (data == "READ") {
+            return true;
+        case CommandHash("READ"):
+            if (command.Verb != "READ") {
+                break;
+            }
             SendSensors(context);
             context.Send(this, &Channel, new TEventData("DONE"));
-        } else if (data == "STOP") {
+            return true;
+        case CommandHash("DUMP"):
+            if (command.Verb != "DUMP") {
+                break;
+            }
+            SensorDumpStart(command, context);
+            return true;
+        case CommandHash("STOP"):
+            if (command.Verb != "STOP") {
+                break;
+            }
             Feed = false;
             Period = DefaultPeriod;
-        } else if (data.starts_with("RESET")) {
-            StringBuf command(data);
-            command.NextToken(' ');
-            StringBuf reason = "CMD";
-            if (!command.empty()) {
-                reason = command;
+            return true;
+        case CommandHash("RESET"):
+            if (command.Verb != "RESET") {
+                break;
             }
-            Reset(reason);
-        } else {
-            context.Send(this, event->Sender, new TEventData(StringStream() << "WRONG " << data));
-        }
-        if (Env::HaveConsole && event->Sender != &Console) {
-            context.Send(this, &Console, event.Release());
+            Reset(command.Tail.empty() ? StringBuf("CMD") : command.Tail);
+            return true;
+        case CommandHash("HELP"):
+            if (command.Verb != "HELP") {
+                break;
+            }
+            for (const char* const* help = GetCommandsHelp(); *help != nullptr; ++help) {
+                context.Send(this, sender, new TEventData(String(*help)));
+            }
+            OnHelp(sender, context);
+            context.Send(this, sender, new TEventData("DONE"));
+            return true;
+        default:
+            break;
         }
-        Led = false;
+        return false;
     }
 
-    template <typename ValueType>
-    void SendSensorValue(const TActorContext& context, StringBuf sourceName, StringBuf valueName, ValueType value) {
-        StringStream stream;
-        stream << "DATA " << sourceName << '.' << valueName << ' ' << value << " OK";
+    void SendLine(const TActorContext& context, StringStream& stream) {
         if (Env::UseSum) {
             auto size = stream.size();
             stream << ' ' << size;
@@ -477,9 +579,20 @@ public:
         context.Send(this, &Channel, new TEventData(stream));
     }
 
+    template <typename ValueType>
+    void SendSensorValue(const TActorContext& context, StringBuf sourceName, StringBuf valueName, ValueType value) {
+        if (Logging) {
+            DataLog->Append(context.Now, sourceName, valueName, fixed3_t(value));
+            return;
+        }
+        StringStream stream;
+        stream << "DATA " << sourceName << '.' << valueName << ' ' << value << " OK";
+        SendLine(context, stream);
+    }
+
     template <typename ValueType>
     void SendSensorValue(const TSensorSource& source, const ValueType& value, const TActorContext& context) {
-        if (source.Updated >= LastReportTime && value.Value.IsValid()) {
+        if (source.Updated >= (Logging ? LastLogTime : LastReportTime) && value.Value.IsValid()) {
             SendSensorValue(context, source.Name, value.Name, value.Value);
         }
     }
@@ -523,6 +636,117 @@ public:
         }
     }
 
+    // while there is no connection the values go to the log instead of the channel
+    void LogSensors(const TActorContext& context) {
+        Logging = true;
+        OnSendSensors(context);
+        Logging = false;
+        LastLogTime = context.Now;
+    }
+
+    // DUMP [since=<log time>] [packed] - sends the log starting from the given time
+    // packed sends "PACK <hex>" lines with TSeriesEncoder blocks instead of "LOG" lines
+    void SensorDumpStart(const TCommand& command, const TActorContext& context) {
+        if (DataLog == nullptr) {
+            context.Send(this, &Channel, new TEventData("DONE"));
+            return;
+        }
+        uint32_t since = 0;
+        DumpPacked = false;
+        for (uint8_t i = 0; i < command.ArgCount; ++i) {
+            StringBuf arg = command.GetArg(i);
+            if (arg.starts_with("since=")) {
+                since = arg.substr(6).toulong();
+            } else if (arg == "packed") {
+                DumpPacked = true;
+            }
+        }
+        size_t index = DataLog->Find(since);
+        DumpTime = since;
+        TLogRecord record;
+        DumpSequence = DataLog->Read(index, record) ? record.Sequence : DataLog->GetSequence();
+        StringStream stream;
+        stream << "DUMP " << (unsigned long)(DataLog->size() - index) << ' ' << (unsigned long)DataLog->GetTime(context.Now) << " OK";
+        SendLine(context, stream);
+        // a new generation, the event of a running dump is dropped
+        context.Send(this, this, new TEventSensorDump(++DumpGeneration));
+    }
+
+    // index of the next record to dump, the records before DumpSequence with the same time were sent already
+    size_t FindDumpIndex() {
+        size_t index = DataLog->Find(DumpTime);
+        TLogRecord record;
+        while (index < DataLog->size()
+            && (!DataLog->Read(index, record) || (record.Time == DumpTime && (int16_t)(record.Sequence - DumpSequence) < 0))) {
+            ++index;
+        }
+        return index;
+    }
+
+    void DumpSent(const TLogRecord& record) {
+        DumpTime = record.Time;
+        DumpSequence = record.Sequence + 1;
+    }
+
+    // sends next batch of the log records, so the channel queue and the link are not flooded
+    void SensorDump(TUniquePtr<TEventSensorDump> event, const TActorContext& context) {
+        if (event->Generation != DumpGeneration) {
+            return;
+        }
+        if (!Channel.CanTransmit()) {
+            event->NotBefore = context.Now + Env::DumpBatchPeriod;
+            context.Resend(this, event.Release());
+            return;
+        }
+        size_t index = FindDumpIndex();
+        for (int i = 0; i < Env::DumpBatchSize && index < DataLog->size(); ++i) {
+            if (DumpPacked) {
+                index = SendPackedRecords(index, context);
+            } else {
+                TLogRecord record;
+                if (DataLog->Read(index, record)) {
+                    StringStream stream;
+                    stream << "LOG " << (unsigned long)record.Time << ' ' << String((unsigned int)record.Id, 16) << ' ' << record.GetValue() << " OK";
+                    SendLine(context, stream);
+                    DumpSent(record);
+                }
+                ++index;
+            }
+        }
+        if (index < DataLog->size()) {
+            event->NotBefore = context.Now + Env::DumpBatchPeriod;
+            context.Resend(this, event.Release());
+        } else {
+            context.Send(this, &Channel, new TEventData("DONE"));
+        }
+    }
+
+    // returns the index of the first record which is not in the block
+    size_t SendPackedRecords(size_t index, const TActorContext& context) {
+        uint8_t block[Env::DumpPackSize];
+        TSeriesEncoder<> encoder(block, sizeof(block));
+        for (; index < DataLog->size(); ++index) {
+            TLogRecord record;
+            if (DataLog->Read(index, record)) {
+                if (!encoder.Append(record.Time, record.GetValue(), record.Id)) {
+                    break;
+                }
+                DumpSent(record);
+            }
+        }
+        size_t size = encoder.Finish();
+        StringStream stream;
+        stream.reserve(size * 2 + 20);
+        stream << "PACK ";
+        for (size_t i = 0; i < size; ++i) {
+            static const char digits[] = "0123456789abcdef";
+            stream << digits[block[i] >> 4] << digits[block[i] & 0x0f];
+        }
+        stream << " OK";
+        SendLine(context, stream);
+        return index;
+    }
+
     void SensorReceive(TUniquePtr<TEventReceive> event, const TActorContext& context) {
         Led = true;
         if (Env::HaveConsole && !Feed) {
@@ -541,6 +765,8 @@ public:
             if (Feed) {
                 //ConnectAliveTime = context.Now;
                 SendSensors(context);
+            } else if (DataLog != nullptr && LastLogTime + Env::LogPeriod <= context.Now) {
+                LogSensors(context);
             }/* else {
                 if (!Connected) {
                     context.Send(this, &Channel, new TEventData("AT"));
@@ -557,6 +783,9 @@ public:
         if (Env::HaveConsole) {
             ActorLib->SendSync(&Console, new TEventData(reason));
         }
+        if (DataLog != nullptr) {
+            DataLog->Sync();
+        }
         PowerI2C = false;
         PowerBluetooth = false;
         for (int i = 0; i < 15; ++i) {
@@ -47,6 +47,17 @@ public:
     static constexpr long GetBaud() {
         return Baud;
     }
+
+    // the core receives in the UART interrupt into a buffer of this size
+    static constexpr unsigned int GetReceiveBufferSize() {
+#if defined(SERIAL_RX_BUFFER_SIZE)
+        return SERIAL_RX_BUFFER_SIZE;
+#elif defined(SERIAL_BUFFER_SIZE)
+        return SERIAL_BUFFER_SIZE;
+#else
+        return 64;
+#endif
+    }
 };
 
 #ifdef ARDUINO_ARCH_STM32F1
@@ -116,22 +127,70 @@ public:
 //#define Serial1 Serial
 //#endif
 
+// line of the serial input, an owned copy of the line, the lines are commands, so they go before the sensors
+struct TEventLineData : TEventData {
+    TEventLineData(StringBuf line)
+        : TEventData(String(line))
+    {
+        Priority = EEventPriority::High;
+    }
+};
+
+// the bytes are received by the core in the UART interrupt, the actor polls its buffer before it could fill up,
+// (half of the buffer at the baud rate) and the lib idles the CPU in between instead of the standby, which would stop the UART,
+// a line is complete on EOL, or when nothing came for IdleTimeout (zero - only EOL, for the console)
+// the port is read straight into the fixed line buffer, each line is copied out of it once (TEventLineData),
+// the unfinished line is moved to the beginning of the buffer when it is full
+// the data to send are queued as they came (the events themselves, no copy), the core transmit buffer is filled from the queue
+// as it is sent by the UART interrupt, at the same polls, so a long report doesn't block anybody,
+// producers of bulk data should wait while !CanTransmit()
 template <typename SerialType>
 class TSerialActor : public TActor {
 public:
     static constexpr String::size_type MaxBufferSize = 128;
+    static constexpr String::size_type TransmitHighWater = 256;
     SerialType Port;
+    TTime IdleTimeout;
 
     TSerialActor(TActor* owner)
         : Owner(owner)
         , EOL("\n")
     {}
 
+    // bytes queued and not yet in the core transmit buffer
+    String::size_type GetTransmitPending() const {
+        return TransmitPending;
+    }
+
+    bool CanTransmit() const {
+        return TransmitPending < TransmitHighWater;
+    }
+
+    // drops the queued data, except the line which is being sent
+    void PurgeTransmit() {
+        auto it = TransmitQueue.begin();
+        if (it != TransmitQueue.end() && TransmitOffset != 0) {
+            TEventData* data = static_cast<TEventData*>((it++).Get());
+            TransmitPending = data->Data.size() + EOL.size() - TransmitOffset;
+        } else {
+            TransmitPending = 0;
+        }
+        while (it != TransmitQueue.end()) {
+            it = TransmitQueue.erase(it);
+        }
+    }
+
 protected:
     TActor* Owner;
-    String Buffer;
     StringBuf EOL;
 
+    char Line[MaxBufferSize];
+    String::size_type LineStart = 0; // of the unfinished line
+    String::size_type LineEnd = 0;
+    TList<TEventPtr> TransmitQueue;
+    String::size_type TransmitOffset = 0; // in the first queued line, the EOL follows the data
+    String::size_type TransmitPending = 0;
+
     void OnEvent(TEventPtr event, const TActorContext& context) override {
         switch (event->EventID) {
         case TEventBootstrap::EventID:
@@ -153,83 +212,133 @@ protected:
 
     void OnBootstrap(TUniquePtr<TEventBootstrap>, const TActorContext& context) {
         Port.Begin();
+        ++context.ActorLib.StandbyLocks;
         context.Send(this, this, new TEventReceive);
     }
 
-	/*static constexpr TTime GetSafeIdleTime() {
-		return TTime::MilliSeconds(ArduinoSettings::GetReceiveBufferSize() * 1000 / (SerialType::GetBaud() / 8));
-	}*/
+    // time to fill a half of the receive buffer, 10 bits per byte
+    static constexpr TTime GetPollPeriod() {
+        return TTime::MilliSeconds(((unsigned long)SerialType::GetReceiveBufferSize() / 2 * 10000 + SerialType::GetBaud() - 1) / SerialType::GetBaud());
+    }
 
-    void OnData(TUniquePtr<TEventData> event, const TActorContext& context) {
-        String::size_type availableForWrite = (String::size_type)Port.AvailableForWrite();
-        if (availableForWrite > 0) {
-            String& data = event->Data;
-            String::size_type len = data.size();
-            if (len + EOL.size() <= availableForWrite) {
-                if (len > 0) {
-                    Port.Write(data.begin(), len);
+    void OnData(TUniquePtr<TEventData> event, const TActorContext&) {
+        TransmitPending += event->Data.size() + EOL.size();
+        TransmitQueue.push_back(event.Release());
+        Transmit();
+    }
+
+    void Transmit() {
+        String::size_type available = (String::size_type)Port.AvailableForWrite();
+        while (available > 0 && !TransmitQueue.empty()) {
+            const String& data = static_cast<TEventData*>(TransmitQueue.front().Get())->Data;
+            String::size_type dataSize = data.size();
+            String::size_type lineSize = dataSize + EOL.size();
+            while (available > 0 && TransmitOffset < lineSize) {
+                const char* chunk;
+                String::size_type size;
+                if (TransmitOffset < dataSize) {
+                    chunk = data.data() + TransmitOffset;
+                    size = dataSize - TransmitOffset;
+                } else {
+                    chunk = EOL.data() + (TransmitOffset - dataSize);
+                    size = lineSize - TransmitOffset;
+                }
+                if (size > available) {
+                    size = available;
+                }
+                size = (String::size_type)Port.Write(chunk, size);
+                if (size == 0) {
+                    return;
                 }
-                Port.Write(EOL.data(), EOL.size());
-                return;
-            } else {
-                Port.Write(data.begin(), availableForWrite);
-                data.erase(0, availableForWrite);
+                TransmitOffset += size;
+                TransmitPending -= size;
+                available -= size;
+            }
+            if (TransmitOffset == lineSize) {
+                TransmitQueue.pop_front();
+                TransmitOffset = 0;
             }
         }
-        context.ResendImmediate(this, event.Release());
     }
 
     bool Sleeping = false;
+    TTime LastReceive;
 
     void OnReceive(TUniquePtr<TEventReceive> event, const TActorContext& context) {
         // TODO: disable for sleep
         if (context.ActorLib.Sleeping) {
             Sleeping = true;
+            --context.ActorLib.StandbyLocks;
             return;
         }
+        event->NotBefore = context.Now + GetPollPeriod();
         context.Resend(this, event.Release());
-        String::size_type size = (String::size_type)min((unsigned int)Port.AvailableForRead(), (MaxBufferSize - Buffer.size()));
-        if (size > 0) {
-            String::size_type strStart = 0;
-            String::size_type bufferPos = Buffer.size();
-            Buffer.reserve(bufferPos + size);
-            size = (String::size_type)Port.Read(Buffer.data() + bufferPos, size);
-            String::size_type bufferSize = bufferPos + size;
-            Buffer.resize(bufferSize);
-            while (bufferPos < bufferSize) {
-                if (Buffer[bufferPos] == '\n') {
-                    String::size_type strSize = bufferPos;
-                    while (strSize > 0 && Buffer[strSize - 1] == '\r') {
-                        --strSize;
-                    }
-                    context.Send(this, Owner, new TEventData(Buffer.substr(strStart, strSize - strStart)));
-                    strStart = bufferPos + 1;
+        Transmit();
+        if (Port.AvailableForRead() > 0) {
+            if (LineEnd == MaxBufferSize) {
+                MoveLine();
+            }
+            String::size_type size = (String::size_type)min((unsigned int)Port.AvailableForRead(), (unsigned int)(MaxBufferSize - LineEnd));
+            size = (String::size_type)Port.Read(Line + LineEnd, size);
+            String::size_type scan = LineEnd;
+            LineEnd += size;
+            LastReceive = context.Now;
+            const char* eol;
+            while ((eol = static_cast<const char*>(memchr(Line + scan, '\n', LineEnd - scan))) != nullptr) {
+                String::size_type end = (String::size_type)(eol - Line);
+                scan = end + 1;
+                while (end > LineStart && Line[end - 1] == '\r') {
+                    --end;
                 }
-                ++bufferPos;
+                SendLine(end, context);
+                LineStart = scan;
             }
-            Buffer = Buffer.substr(strStart, bufferPos - strStart);
-            if (bufferSize >= MaxBufferSize) {
-                context.Send(this, Owner, new TEventData(Buffer));
-                Buffer.clear();
+            if (LineStart == 0 && LineEnd == MaxBufferSize) {
+                SendLine(LineEnd, context);
+                LineStart = LineEnd;
             }
+        } else if (IdleTimeout != TTime() && LineStart != LineEnd && context.Now - LastReceive >= IdleTimeout) {
+            SendLine(LineEnd, context);
+            LineStart = LineEnd;
         }
-        //context.ResendAfter(this, event.Release(), GetSafeIdleTime());
     }
 
+    void SendLine(String::size_type end, const TActorContext& context) {
+        context.Send(this, Owner, new TEventLineData(StringBuf(Line + LineStart, end - LineStart)));
+    }
+
+    // moves the unfinished line to the beginning of the buffer
+    void MoveLine() {
+        LineEnd -= LineStart;
+        memmove(Line, Line + LineStart, LineEnd);
+        LineStart = 0;
+    }
+
+    // the queue is sent in the time it takes at the baud rate, a port which doesn't drain (USB CDC without the host)
+    // keeps the rest for the wake-up, instead of spinning until the watchdog reset
     void OnSleep(TUniquePtr<TEventSleep>, const TActorContext&) {
-        Port.Flush();
+        TTime deadline = TTime::Now() + TTime::MilliSeconds((unsigned long)TransmitPending * 10000 / SerialType::GetBaud()) + GetPollPeriod();
+        Transmit();
+        while (!TransmitQueue.empty() && TTime::Now() < deadline) {
+            Transmit();
+        }
+        if (TransmitQueue.empty()) {
+            Port.Flush();
+        }
     }
 
     void OnWakeUp(TUniquePtr<TEventWakeUp>, const TActorContext& context) {
-        Buffer.clear();
+        LineStart = LineEnd;
         Port.SkipAll();
         if (Sleeping) {
+            ++context.ActorLib.StandbyLocks;
             context.Send(this, this, new TEventReceive);
             Sleeping = false;
         }
     }
 };
 
+// the data are written to the port when they are sent, not at the next run, what doesn't fit is continued in the background
 template <typename SerialType>
 class TSyncSerialActor : public TSerialActor<SerialType> {
 public:
@@ -246,24 +355,154 @@ public:
             return TBase::OnSend(Move(event), context);
         }
     }
+};
+
+// request / response transactions over a UART for binary protocols (MH-Z19, PMS, Modbus...)
+// the owner sends TEventSerialRequest, the request is written at once and the response is collected
+// by polling the port at the byte rate, TEventSerialResponse is sent back when ResponseSize bytes arrived,
+// or on timeout, nothing blocks, requests coming during a transaction wait for it to finish
+// ChecksumType::Check(data, size) validates the complete response
+struct TNoChecksum {
+    static bool Check(const char*, String::size_type) {
+        return true;
+    }
+};
+
+// the last byte is the two's complement of the sum of all bytes except the first one (Winsen sensors)
+struct TComplementChecksum {
+    static uint8_t Get(const char* data, String::size_type size) {
+        uint8_t sum = 0;
+        for (String::size_type i = 1; i + 1 < size; ++i) {
+            sum += (uint8_t)data[i];
+        }
+        return (uint8_t)(0xff - sum + 1);
+    }
+
+    static bool Check(const char* data, String::size_type size) {
+        return size >= 2 && Get(data, size) == (uint8_t)data[size - 1];
+    }
+};
+
+enum class ESerialStatus : uint8_t {
+    Ok,
+    Timeout,
+    BadChecksum,
+};
+
+struct TEventSerialRequest : TBasicEvent<TEventSerialRequest> {
+    constexpr static TEventID EventID = TEventID::EventSerialRequest;
+    String Data;
+    // 0 - no response expected, no TEventSerialResponse will be sent
+    uint8_t ResponseSize;
+    TTime Timeout;
+
+    TEventSerialRequest(String data, uint8_t responseSize, TTime timeout = TTime::MilliSeconds(200))
+        : Data(Move(data))
+        , ResponseSize(responseSize)
+        , Timeout(timeout)
+    {}
+};
+
+struct TEventSerialResponse : TBasicEvent<TEventSerialResponse> {
+    constexpr static TEventID EventID = TEventID::EventSerialResponse;
+    String Data;
+    ESerialStatus Status;
+
+    TEventSerialResponse(String data, ESerialStatus status)
+        : Data(Move(data))
+        , Status(status)
+    {}
+};
+
+template <typename SerialType, typename ChecksumType = TNoChecksum>
+class TSerialTransactionActor : public TActor {
+public:
+    SerialType Port;
+
+    bool IsBusy() const {
+        return Request.Get() != nullptr;
+    }
 
 protected:
+    TUniquePtr<TEventSerialRequest> Request;
+    String Response;
+    TTime Deadline;
+
+    // time to transfer the bytes, 10 bits per byte
+    static TTime GetTransferTime(String::size_type bytes) {
+        unsigned long ms = ((unsigned long)bytes * 10000 + SerialType::GetBaud() - 1) / SerialType::GetBaud();
+        return TTime::MilliSeconds(ms > 0 ? ms : 1);
+    }
+
     void OnEvent(TEventPtr event, const TActorContext& context) override {
         switch (event->EventID) {
-        case TEventData::EventID:
-            return OnData(static_cast<TEventData*>(event.Release()), context);
+        case TEventBootstrap::EventID:
+            return OnBootstrap(static_cast<TEventBootstrap*>(event.Release()), context);
+        case TEventSerialRequest::EventID:
+            return OnRequest(static_cast<TEventSerialRequest*>(event.Release()), context);
+        case TEventReceive::EventID:
+            return OnReceive(static_cast<TEventReceive*>(event.Release()), context);
         default:
-            return TBase::OnEvent(Move(event), context);
+            break;
         }
     }
 
-    void OnData(TUniquePtr<TEventData> event, const TActorContext&) {
-        String& data = event->Data;
-        int len = data.size();
-        if (len > 0) {
-            TBase::Port.Write(data.begin(), len);
+    void OnBootstrap(TUniquePtr<TEventBootstrap>, const TActorContext&) {
+        Port.Begin();
+    }
+
+    void OnRequest(TUniquePtr<TEventSerialRequest> event, const TActorContext& context) {
+        if (IsBusy()) {
+            event->NotBefore = Deadline;
+            context.Resend(this, event.Release());
+            return;
+        }
+        Port.SkipAll();
+        Port.Write(event->Data.data(), event->Data.size());
+        if (event->ResponseSize == 0) {
+            return;
+        }
+        Response.clear();
+        Response.reserve(event->ResponseSize);
+        Deadline = context.Now + event->Timeout;
+        context.Send(this, this, new TEventReceive(context.Now + GetTransferTime(event->Data.size() + event->ResponseSize)));
+        Request = event.Release();
+        // the standby stops the SERCOM, SoftwareSerial needs the CPU, the response would be lost
+        ++context.ActorLib.StandbyLocks;
+    }
+
+    void OnReceive(TUniquePtr<TEventReceive> event, const TActorContext& context) {
+        if (!IsBusy()) {
+            return;
+        }
+        String::size_type size = Response.size();
+        String::size_type required = Request->ResponseSize - size;
+        String::size_type available = (String::size_type)min((unsigned int)Port.AvailableForRead(), (unsigned int)required);
+        if (available > 0) {
+            Response.resize(size + available);
+            available = (String::size_type)Port.Read(Response.data() + size, available);
+            Response.resize(size + available);
+            required -= available;
+        }
+        if (required == 0) {
+            ESerialStatus status = ChecksumType::Check(Response.data(), Response.size()) ? ESerialStatus::Ok : ESerialStatus::BadChecksum;
+            return Complete(status, context);
+        }
+        if (context.Now >= Deadline) {
+            return Complete(ESerialStatus::Timeout, context);
+        }
+        event->NotBefore = context.Now + GetTransferTime(required);
+        context.Resend(this, event.Release());
+    }
+
+    void Complete(ESerialStatus status, const TActorContext& context) {
+        TActor* recipient = Request->Sender;
+        Request = nullptr;
+        --context.ActorLib.StandbyLocks;
+        if (recipient != nullptr) {
+            context.Send(this, recipient, new TEventSerialResponse(Move(Response), status));
         }
-        TBase::Port.Write(TBase::EOL.data(), TBase::EOL.size());
+        Response = String();
     }
 };
 
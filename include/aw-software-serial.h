@@ -34,9 +34,23 @@ public:
         return Port.readBytes(buffer, length);
     }
 
+    void Flush() {
+        Port.flush();
+    }
+
+    void SkipAll() {
+        while (Port.available() > 0) {
+            Port.read();
+        }
+    }
+
     static constexpr long GetBaud() {
         return Baud;
     }
+
+    static constexpr unsigned int GetReceiveBufferSize() {
+        return _SS_MAX_RX_BUFF;
+    }
 };
 
 }
@@ -2,6 +2,11 @@
 #ifdef ARDUINO_ARCH_AVR
 //#include <avr/eeprom.h>
 #endif
+#ifndef ARDUINO
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#endif
 
 namespace AW {
 
@@ -19,7 +24,535 @@ public:
     static void write(uint16_t offset, uint8_t byte) {
         eeprom_write_byte(reinterpret_cast<uint8_t*>(offset), byte);
     }
+
+    static void read(uint16_t offset, uint8_t* data, uint16_t size) {
+        eeprom_read_block(data, reinterpret_cast<const void*>(offset), size);
+    }
+
+    static void write(uint16_t offset, const uint8_t* data, uint16_t size) {
+        eeprom_update_block(data, reinterpret_cast<void*>(offset), size);
+    }
+
+    static void Sync() {}
+};
+#endif
+
+#ifdef ARDUINO_ARCH_SAMD
+// raw internal flash of SAMD21, Size bytes are reserved at the end of the program image
+// pages are 64 bytes, erase granularity is a row of 4 pages
+template <size_t Size>
+class TSAMDFlash {
+public:
+    static constexpr size_t PageSize = 64;
+    static constexpr size_t RowSize = PageSize * 4;
+    static constexpr size_t FlashSize = (Size + RowSize - 1) / RowSize * RowSize;
+
+    static constexpr size_t size() {
+        return FlashSize;
+    }
+
+    static void Read(size_t address, uint8_t* data, size_t size) {
+        // volatile to prevent folding of the (all zeroes) initializer
+        const volatile uint8_t* flash = Flash + address;
+        while (size-- > 0) {
+            *data++ = *flash++;
+        }
+    }
+
+    static void EraseRow(size_t address) {
+        NVMCTRL->ADDR.reg = ((uint32_t)(Flash + address)) / 2;
+        NVMCTRL->CTRLA.reg = NVMCTRL_CTRLA_CMDEX_KEY | NVMCTRL_CTRLA_CMD_ER;
+        WaitReady();
+    }
+
+    static void WritePage(size_t address, const uint8_t* data) {
+        NVMCTRL->CTRLB.bit.MANW = 1;
+        NVMCTRL->CTRLA.reg = NVMCTRL_CTRLA_CMDEX_KEY | NVMCTRL_CTRLA_CMD_PBC;
+        WaitReady();
+        volatile uint32_t* dst = reinterpret_cast<volatile uint32_t*>(const_cast<uint8_t*>(Flash) + address);
+        for (size_t i = 0; i < PageSize; i += sizeof(uint32_t)) {
+            uint32_t word;
+            memcpy(&word, data + i, sizeof(word));
+            *dst++ = word;
+        }
+        NVMCTRL->ADDR.reg = ((uint32_t)(Flash + address)) / 2;
+        NVMCTRL->CTRLA.reg = NVMCTRL_CTRLA_CMDEX_KEY | NVMCTRL_CTRLA_CMD_WP;
+        WaitReady();
+    }
+
+protected:
+    static void WaitReady() {
+        while (NVMCTRL->INTFLAG.bit.READY == 0) {}
+    }
+
+    __attribute__((__aligned__(RowSize))) static const uint8_t Flash[FlashSize];
+};
+
+template <size_t Size>
+__attribute__((__aligned__(TSAMDFlash<Size>::RowSize))) const uint8_t TSAMDFlash<Size>::Flash[TSAMDFlash<Size>::FlashSize] = {};
+#endif
+
+#ifndef ARDUINO
+// host emulation of a NOR flash in a file, for tests
+// erase sets bytes to 0xff, page writes can only clear bits
+template <size_t Size, size_t Page = 64, size_t Row = 256>
+class TFileFlash {
+public:
+    static constexpr size_t PageSize = Page;
+    static constexpr size_t RowSize = Row;
+
+    TFileFlash(const char* path) {
+        File = fopen(path, "r+b");
+        if (File == nullptr) {
+            File = fopen(path, "w+b");
+            if (File == nullptr) {
+                // reads as erased, writes are lost
+                fprintf(stderr, "TFileFlash: can't open %s: %s\n", path, strerror(errno));
+                return;
+            }
+            uint8_t erased[RowSize];
+            memset(erased, 0xff, sizeof(erased));
+            for (size_t row = 0; row < size(); row += RowSize) {
+                fwrite(erased, 1, RowSize, File);
+            }
+        }
+    }
+
+    ~TFileFlash() {
+        if (File != nullptr) {
+            fclose(File);
+        }
+    }
+
+    bool IsOpen() const {
+        return File != nullptr;
+    }
+
+    static constexpr size_t size() {
+        return (Size + RowSize - 1) / RowSize * RowSize;
+    }
+
+    void Read(size_t address, uint8_t* data, size_t size) {
+        if (File == nullptr) {
+            memset(data, 0xff, size);
+            return;
+        }
+        fseek(File, (long)address, SEEK_SET);
+        fread(data, 1, size, File);
+    }
+
+    void EraseRow(size_t address) {
+        if (File == nullptr) {
+            return;
+        }
+        uint8_t erased[RowSize];
+        memset(erased, 0xff, sizeof(erased));
+        fseek(File, (long)(address - address % RowSize), SEEK_SET);
+        fwrite(erased, 1, RowSize, File);
+        ++Erases;
+    }
+
+    void WritePage(size_t address, const uint8_t* data) {
+        if (File == nullptr) {
+            return;
+        }
+        uint8_t page[PageSize];
+        Read(address, page, PageSize);
+        for (size_t i = 0; i < PageSize; ++i) {
+            page[i] &= data[i];
+        }
+        fseek(File, (long)address, SEEK_SET);
+        fwrite(page, 1, PageSize, File);
+        fflush(File);
+        ++Writes;
+    }
+
+    unsigned long Erases = 0;
+    unsigned long Writes = 0;
+
+protected:
+    FILE* File;
 };
 #endif
 
+// the same NOR flash emulation in RAM, for the tests on the board, where there is no file system
+template <size_t Size, size_t Page = 64, size_t Row = 256>
+class TRAMFlash {
+public:
+    static constexpr size_t PageSize = Page;
+    static constexpr size_t RowSize = Row;
+
+    TRAMFlash() {
+        memset(Data, 0xff, sizeof(Data));
+    }
+
+    static constexpr size_t size() {
+        return (Size + RowSize - 1) / RowSize * RowSize;
+    }
+
+    void Read(size_t address, uint8_t* data, size_t size) const {
+        memcpy(data, Data + address, size);
+    }
+
+    void EraseRow(size_t address) {
+        memset(Data + address - address % RowSize, 0xff, RowSize);
+        ++Erases;
+    }
+
+    void WritePage(size_t address, const uint8_t* data) {
+        for (size_t i = 0; i < PageSize; ++i) {
+            Data[address + i] &= data[i];
+        }
+        ++Writes;
+    }
+
+    unsigned long Erases = 0;
+    unsigned long Writes = 0;
+
+protected:
+    uint8_t Data[size()];
+};
+
+// byte array of Size bytes on top of a raw flash with PageSize / RowSize, Read, EraseRow and WritePage
+// the flash is split into two banks, every Sync() writes the whole image to the inactive bank
+// and finishes it with a footer (sequence number and CRC) in the last page, so a power loss in the middle
+// of a write leaves the previous bank valid; the newest valid bank is loaded on start
+// reads and writes work on a RAM copy of the data
+template <typename TFlash, size_t Size>
+class TFlashByteArray {
+public:
+    TFlashByteArray(TFlash& flash)
+        : Flash(flash)
+    {
+        static_assert(TFlash::size() >= BankSize * 2, "flash is too small");
+        Mount();
+    }
+
+    static constexpr size_t length() {
+        return Size;
+    }
+
+    uint8_t read(size_t offset) const {
+        return Data[offset];
+    }
+
+    void write(size_t offset, uint8_t byte) {
+        if (Data[offset] != byte) {
+            Data[offset] = byte;
+            Dirty = true;
+        }
+    }
+
+    void read(size_t offset, uint8_t* data, size_t size) const {
+        memcpy(data, Data + offset, size);
+    }
+
+    void write(size_t offset, const uint8_t* data, size_t size) {
+        if (memcmp(Data + offset, data, size) != 0) {
+            memcpy(Data + offset, data, size);
+            Dirty = true;
+        }
+    }
+
+    bool IsDirty() const {
+        return Dirty;
+    }
+
+    uint32_t GetSequence() const {
+        return Sequence;
+    }
+
+    void Sync() {
+        if (!Dirty) {
+            return;
+        }
+        uint8_t bank = ActiveBank ^ 1;
+        size_t base = bank * BankSize;
+        for (size_t row = 0; row < BankSize; row += TFlash::RowSize) {
+            Flash.EraseRow(base + row);
+        }
+        uint8_t page[TFlash::PageSize];
+        for (size_t offset = 0; offset < BankSize; offset += TFlash::PageSize) {
+            memset(page, 0xff, sizeof(page));
+            if (offset < Size) {
+                memcpy(page, Data + offset, min((size_t)TFlash::PageSize, Size - offset));
+            }
+            if (offset + TFlash::PageSize == BankSize) {
+                TFooter footer;
+                footer.Magic = Magic;
+                footer.Crc = GetCrc();
+                footer.Sequence = Sequence + 1;
+                memcpy(page + TFlash::PageSize - sizeof(footer), &footer, sizeof(footer));
+            }
+            Flash.WritePage(base + offset, page);
+        }
+        ++Sequence;
+        ActiveBank = bank;
+        Dirty = false;
+    }
+
+protected:
+    struct TFooter {
+        uint32_t Sequence;
+        uint16_t Crc;
+        uint16_t Magic;
+    };
+
+    static constexpr uint16_t Magic = 0xA55A;
+    static constexpr size_t BankSize = (Size + sizeof(TFooter) + TFlash::RowSize - 1) / TFlash::RowSize * TFlash::RowSize;
+
+    TFlash& Flash;
+    uint8_t Data[Size];
+    uint32_t Sequence = 0;
+    uint8_t ActiveBank = 1;
+    bool Dirty = false;
+
+    uint16_t GetCrc() const {
+        return StringBuf(reinterpret_cast<const char*>(Data), Size).crc16();
+    }
+
+    bool ReadBank(uint8_t bank, TFooter& footer) {
+        size_t base = bank * BankSize;
+        Flash.Read(base + BankSize - sizeof(footer), reinterpret_cast<uint8_t*>(&footer), sizeof(footer));
+        if (footer.Magic != Magic) {
+            return false;
+        }
+        Flash.Read(base, Data, Size);
+        return footer.Crc == GetCrc();
+    }
+
+    void Mount() {
+        TFooter footer0;
+        TFooter footer1;
+        bool valid0 = ReadBank(0, footer0);
+        bool valid1 = ReadBank(1, footer1);
+        if (valid0 && (!valid1 || (int32_t)(footer0.Sequence - footer1.Sequence) > 0)) {
+            ReadBank(0, footer0);
+            ActiveBank = 0;
+            Sequence = footer0.Sequence;
+        } else if (valid1) {
+            ActiveBank = 1;
+            Sequence = footer1.Sequence;
+        } else {
+            memset(Data, 0xff, Size);
+            ActiveBank = 1;
+            Sequence = 0;
+        }
+    }
+};
+
+// RAM page cache in front of any byte array with block read(offset, data, size) / write(offset, data, size)
+// it is a byte array itself, so it could be used by TFileSystem directly
+// writes are kept in the cache and go to the underlying array only on Sync() or page eviction,
+// coalesced into contiguous runs of changed bytes
+template <typename TByteArray, uint16_t PageSize = 32, uint8_t Pages = 4>
+class TCachedByteArray {
+public:
+    TCachedByteArray(TByteArray& array)
+        : ByteArray(array)
+    {}
+
+    ~TCachedByteArray() {
+        Sync();
+    }
+
+    size_t length() const {
+        return ByteArray.length();
+    }
+
+    uint8_t read(size_t offset) {
+        TPage& page = GetPage(offset);
+        return page.Data[offset - page.Offset];
+    }
+
+    void write(size_t offset, uint8_t byte) {
+        TPage& page = GetPage(offset);
+        uint16_t pos = (uint16_t)(offset - page.Offset);
+        if (page.Data[pos] != byte) {
+            page.Data[pos] = byte;
+            page.SetDirty(pos);
+        }
+    }
+
+    void read(size_t offset, uint8_t* data, size_t size) {
+        while (size > 0) {
+            TPage& page = GetPage(offset);
+            uint16_t pos = (uint16_t)(offset - page.Offset);
+            uint16_t chunk = (uint16_t)min(size, (size_t)(PageSize - pos));
+            memcpy(data, page.Data + pos, chunk);
+            data += chunk;
+            offset += chunk;
+            size -= chunk;
+        }
+    }
+
+    void write(size_t offset, const uint8_t* data, size_t size) {
+        while (size > 0) {
+            TPage& page = GetPage(offset);
+            uint16_t pos = (uint16_t)(offset - page.Offset);
+            uint16_t chunk = (uint16_t)min(size, (size_t)(PageSize - pos));
+            for (uint16_t i = 0; i < chunk; ++i) {
+                if (page.Data[pos + i] != data[i]) {
+                    page.Data[pos + i] = data[i];
+                    page.SetDirty(pos + i);
+                }
+            }
+            data += chunk;
+            offset += chunk;
+            size -= chunk;
+        }
+    }
+
+    bool IsDirty() const {
+        for (const TPage& page : Cache) {
+            if (page.IsDirty()) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void Sync() {
+        for (TPage& page : Cache) {
+            Flush(page);
+        }
+        ByteArray.Sync();
+    }
+
+    // drops all cached pages, e.g. after the underlying array was changed directly
+    void Invalidate() {
+        Sync();
+        for (TPage& page : Cache) {
+            page.Offset = NoPage;
+        }
+    }
+
+protected:
+    static constexpr size_t NoPage = ~(size_t)0;
+
+    struct TPage {
+        size_t Offset = NoPage;
+        uint8_t Used = 0;
+        uint8_t Data[PageSize];
+        uint8_t Dirty[(PageSize + 7) / 8] = {};
+
+        void SetDirty(uint16_t pos) {
+            Dirty[pos / 8] |= (uint8_t)(1 << (pos % 8));
+        }
+
+        bool IsDirty(uint16_t pos) const {
+            return (Dirty[pos / 8] & (1 << (pos % 8))) != 0;
+        }
+
+        bool IsDirty() const {
+            for (uint8_t d : Dirty) {
+                if (d != 0) {
+                    return true;
+                }
+            }
+            return false;
+        }
+    };
+
+    TByteArray& ByteArray;
+    TPage Cache[Pages];
+    uint8_t Tick = 0;
+
+    // of the page within the array, zero for a page past its end
+    uint16_t GetPageSize(const TPage& page) const {
+        size_t length = this->length();
+        return page.Offset < length ? (uint16_t)min((size_t)PageSize, length - page.Offset) : 0;
+    }
+
+    TPage& GetPage(size_t offset) {
+        size_t pageOffset = offset - offset % PageSize;
+        TPage* victim = &Cache[0];
+        for (TPage& page : Cache) {
+            if (page.Offset == pageOffset) {
+                page.Used = ++Tick;
+                return page;
+            }
+            if (page.Offset == NoPage) {
+                victim = &page;
+            } else if (victim->Offset != NoPage && (uint8_t)(Tick - page.Used) > (uint8_t)(Tick - victim->Used)) {
+                victim = &page;
+            }
+        }
+        Flush(*victim);
+        victim->Offset = pageOffset;
+        victim->Used = ++Tick;
+        uint16_t size = GetPageSize(*victim);
+        if (size != 0) {
+            ByteArray.read(pageOffset, victim->Data, size);
+        }
+        // the bytes past the end of the array read as zeros, the writes there are dropped by Flush
+        memset(victim->Data + size, 0, PageSize - size);
+        return *victim;
+    }
+
+    void Flush(TPage& page) {
+        if (page.Offset == NoPage || !page.IsDirty()) {
+            return;
+        }
+        uint16_t size = GetPageSize(page);
+        uint16_t pos = 0;
+        while (pos < size) {
+            if (page.IsDirty(pos)) {
+                uint16_t end = pos + 1;
+                while (end < size && page.IsDirty(end)) {
+                    ++end;
+                }
+                ByteArray.write(page.Offset + pos, page.Data + pos, end - pos);
+                pos = end;
+            } else {
+                ++pos;
+            }
+        }
+        memset(page.Dirty, 0, sizeof(page.Dirty));
+    }
+};
+
+// flushes a cached byte array periodically and before sleep
+// TActorLib::Sleep() doesn't broadcast TEventSleep, the owner going to sleep should send it here
+// (TSensorActor syncs its own DataLog in SensorSleep)
+template <typename StorageType>
+class TStorageSyncActor : public TActor {
+public:
+    StorageType& Storage;
+    TTime Period;
+
+    TStorageSyncActor(StorageType& storage, TTime period = TTime::Minutes(5))
+        : Storage(storage)
+        , Period(period)
+    {}
+
+protected:
+    void OnEvent(TEventPtr event, const TActorContext& context) override {
+        switch (event->EventID) {
+        case TEventBootstrap::EventID:
+            return OnBootstrap(static_cast<TEventBootstrap*>(event.Release()), context);
+        case TEventReceive::EventID:
+            return OnReceive(static_cast<TEventReceive*>(event.Release()), context);
+        case TEventSleep::EventID:
+            return OnSleep(static_cast<TEventSleep*>(event.Release()), context);
+        default:
+            break;
+        }
+    }
+
+    void OnBootstrap(TUniquePtr<TEventBootstrap>, const TActorContext& context) {
+        context.Send(this, this, new TEventReceive(context.Now + Period));
+    }
+
+    void OnReceive(TUniquePtr<TEventReceive> event, const TActorContext& context) {
+        Storage.Sync();
+        event->NotBefore = context.Now + Period;
+        context.Resend(this, event.Release());
+    }
+
+    void OnSleep(TUniquePtr<TEventSleep>, const TActorContext&) {
+        Storage.Sync();
+    }
+};
+
 }
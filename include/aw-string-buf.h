@@ -115,7 +115,7 @@ public:
     }
 
     StringBuf NextToken(char delimeter = ' ');
-    uint16_t crc16() const;
+    uint16_t crc16(uint16_t crc = 0xffff) const;
     static char* dtostrf(double __val, signed char __width, unsigned char __prec, char* __s);
 
 protected:
@@ -1,6 +1,6 @@
 namespace AW {
 
-class TToneActor : public TActor {
+class TToneActor : public THandles<TToneActor, TEventData> {
 protected:
     unsigned char Pin;
 public:
@@ -8,16 +8,7 @@ public:
         : Pin(pin)
     {}
 
-    void OnEvent(TEventPtr event, const TActorContext& context) override {
-        switch (event->EventID) {
-        case TEventData::EventID:
-            return OnData(static_cast<TEventData*>(event.Release()), context);
-        default:
-            break;
-        }
-    }
-
-    void OnData(TUniquePtr<TEventData> event, const TActorContext& context) {
+    void Handle(TUniquePtr<TEventData> event, const TActorContext& context) {
         noTone(Pin);
         while (!event->Data.empty()) {
             char c = event->Data[0];
@@ -104,6 +104,9 @@ enum TEventID : uint8_t {
     EventScheduledFunction,
     EventSleep,
     EventWakeUp,
+    EventSignal,
+    EventSerialRequest,
+    EventSerialResponse,
     EventPrivate0,
     EventPrivate1,
     EventPrivate2,
@@ -135,12 +138,41 @@ public:
     virtual void OnEvent(TEventPtr event, const TActorContext& context) = 0;
     virtual void OnSend(TEventPtr event, const TActorContext& context);
     void PurgeEvents(TEventID eventId);
+
+    // safe to call from an interrupt, the actor gets TEventSignal on the next Run() and the lib doesn't sleep until then
+    void Signal() {
+        Signalled = true;
+        SignalPending = true;
+    }
+
+protected:
+    volatile bool Signalled = false;
+    static volatile bool SignalPending;
+
+    // the last scan of Events by the lib, valid until the events change or NextDue comes,
+    // an actor changing NotBefore of its queued event should set EventsChanged
+    TEvent* FirstDue = nullptr;
+    TTime NextDue = TTime::Max(); // of the events not due at the scan
+    uint8_t DueCount = 0;
+    bool EventsChanged = true;
+};
+
+// the due events of a higher class are run first, inside a class the one which is due for the longest time (NotBefore),
+// the relative deadline is the same for all events of a class, so it's the earliest deadline first
+enum class EEventPriority : uint8_t {
+    High, // commands and replies
+    Normal,
+    Low,
 };
 
 struct TEvent : TList<TUniquePtr<TEvent>>::TItemBase {
     TTime NotBefore;
-    TActor* Sender;
+    TActor* Sender = nullptr;
     TEventID EventID;
+    EEventPriority Priority = EEventPriority::Normal;
+
+    // events are deleted through TEventPtr, the members of the derived ones (String) should be freed too
+    virtual ~TEvent() = default;
 };
 
 template <typename DerivedType>
@@ -163,6 +195,11 @@ public:
     TTime BusyTime;
     TTime SleepTime;
     bool Sleeping = false;
+    // actors receiving by the peripherals which stop in the standby (UART), while any holds it
+    // the lib only idles the CPU until the next event, the interrupts keep running
+    uint8_t StandbyLocks = 0;
+    // the longest time from NotBefore to the start of the handler, by EEventPriority
+    TTime MaxLatency[3];
 
     TActorLib();
     void Register(TActor* actor, TTime drift = TTime());
@@ -176,6 +213,13 @@ public:
     void WakeUp();
 
 protected:
+    uint16_t SleepRemainder = 0; // of the measured sleep not in SleepTime yet, 1/1024 ms
+
+    void Idle(TTime until);
+    void AddSleep(uint32_t ticks);
+    static bool IsBefore(const TEvent& event, const TEvent& other);
+    static void ScanEvents(TActor* actor, TTime now);
+
     //TDeque<TEventPtr, 16> Events;
 
     TActor* Actors = nullptr;
@@ -197,6 +241,33 @@ struct TActorContext {
     void ResendAfter(TActor* recipient, TEventPtr event, TTime time) const;
 };
 
+// handler table of an actor generated at compile time, instead of the OnEvent switch:
+// class TMyActor : public THandles<TMyActor, TEventBootstrap, TEventReceive> with Handle(TUniquePtr<TEventBootstrap>, context)
+// and Handle(TUniquePtr<TEventReceive>, context), the event is passed to its Handle directly, an event in the list
+// without the Handle is a compile error, the events not in the list are dropped
+// the handlers could be protected with friend THandles in the actor
+template <typename DerivedType, typename... EventTypes>
+class THandles : public TActor {
+public:
+    void OnEvent(TEventPtr event, const TActorContext& context) override {
+        Dispatch(event, context, TEventList<EventTypes...>());
+    }
+
+protected:
+    template <typename... Types>
+    struct TEventList {};
+
+    void Dispatch(TEventPtr&, const TActorContext&, TEventList<>) {}
+
+    template <typename EventType, typename... OtherTypes>
+    void Dispatch(TEventPtr& event, const TActorContext& context, TEventList<EventType, OtherTypes...>) {
+        if (event->EventID == EventType::EventID) {
+            return static_cast<DerivedType*>(this)->Handle(TUniquePtr<EventType>(static_cast<EventType*>(event.Release())), context);
+        }
+        Dispatch(event, context, TEventList<OtherTypes...>());
+    }
+};
+
 struct TEventScheduledFunction : TBasicEvent<TEventScheduledFunction> {
     constexpr static TEventID EventID = TEventID::EventScheduledFunction;
     TFunction Function;
@@ -209,16 +280,10 @@ struct TEventScheduledFunction : TBasicEvent<TEventScheduledFunction> {
     }
 };
 
-class TSchedulerActor : public TActor {
+class TSchedulerActor : public THandles<TSchedulerActor, TEventScheduledFunction> {
 public:
-    void OnEvent(TEventPtr event, const TActorContext&) override {
-        switch (event->EventID) {
-        case TEventScheduledFunction::EventID:
-            static_cast<TEventScheduledFunction*>(event.Release())->Function();
-            break;
-        default:
-            break;
-        }
+    void Handle(TUniquePtr<TEventScheduledFunction> event, const TActorContext&) {
+        event->Function();
     }
 
     template <typename lambda>
@@ -355,6 +420,7 @@ public:
     }
 };
 
+// analogRead() conflicts with the running TADCSampler, use TADCSampler::AnalogRead() then
 template <uint8_t PIN>
 class TAnalogPin : public TPin<PIN> {
 public:
@@ -716,6 +782,11 @@ struct TEventWakeUp : TBasicEvent<TEventWakeUp> {
     }
 };
 
+struct TEventSignal : TBasicEvent<TEventSignal> {
+    constexpr static TEventID EventID = TEventID::EventSignal;
+    TEventSignal() = default;
+};
+
 } // namespace AW
 
 #include "aw-led.h"
@@ -723,6 +794,8 @@ struct TEventWakeUp : TBasicEvent<TEventWakeUp> {
 #include "aw-serial.h"
 #include "aw-fixed.h"
 #include "aw-tone.h"
+#include "aw-log.h"
+#include "aw-codec.h"
 
 namespace AW {
 
@@ -748,6 +821,13 @@ struct TDefaultEnvironment {
     static constexpr int BluetoothBaudRate = 9600;
     static constexpr int AverageSensorWindow = 60;
 
+    // data log, which is filled while there is no connection
+    using DataLog = TNoDataLog;
+    static constexpr TTime LogPeriod = TTime::Minutes(1);
+    static constexpr int DumpBatchSize = 8;
+    static constexpr TTime DumpBatchPeriod = TTime::MilliSeconds(100);
+    static constexpr size_t DumpPackSize = 64;
+
     // pins
     static constexpr uint8_t PIN_POWER_BLUETOOTH = 8;
     static constexpr uint8_t PIN_POWER_I2C = 0; // 9
@@ -1,31 +1,30 @@
 #pragma once
 
-#include "ArduinoWorkflow.h"
+#include "aw.h"
+#include "aw-adc.h"
 
 namespace AW {
 
+// value is the average of all ADC samples taken by TADCSampler during the period,
+// 0..1 of the reference voltage multiplied by the coefficient
 template <typename Env = TDefaultEnvironment>
-class TSensorAnalog : public TActor {
+class TSensorAnalog : public TActor, public TSensorSource {
 public:
     TActor* Owner;
-    TSensor<1> Sensor;
-    float Coefficient;
-
-    enum ESensor {
-        Analog
-    };
-    
-    TSensorAnalog(uint8_t pin, TActor* owner, StringBuf name = "some", StringBuf value = "analog", float coefficient = 1.0)
+    TSensorValueFixed3 Analog;
+    fixed3_t Coefficient;
+
+    TSensorAnalog(uint8_t pin, TActor* owner, StringBuf name = "some", StringBuf value = "analog", fixed3_t coefficient = 1)
         : Owner(owner)
         , Coefficient(coefficient)
-        , PinValue(pin, INPUT)
+        , Channel(TADCSampler::AddChannel(pin))
     {
-        Sensor.Name = name;
-        Sensor.Values[ESensor::Analog].Name = value;
+        Name = name;
+        Analog.Name = value;
     }
 
 protected:
-    TAnalogPin PinValue;
+    int8_t Channel;
 
     void OnEvent(TEventPtr event, const TActorContext& context) override {
         switch (event->EventID) {
@@ -39,18 +38,27 @@ protected:
     }
 
     void OnBootstrap(TUniquePtr<TEventBootstrap>, const TActorContext& context) {
+        TADCSampler::Begin(context.ActorLib);
         context.Send(this, this, new AW::TEventReceive(context.Now + Env::SensorsPeriod));
     }
 
     void OnReceive(AW::TUniquePtr<AW::TEventReceive> event, const AW::TActorContext& context) {
-        Sensor.Values[ESensor::Analog].Value = PinValue.GetValue() * Coefficient;
-        Sensor.Updated = context.Now;
-        if (Env::SensorsSendValues) {
-            context.Send(this, Owner, new AW::TEventSensorData(Sensor, Sensor.Values[ESensor::Analog]));
+        if (Channel >= 0) {
+            TADCSampler::Poll();
+            uint32_t sum;
+            uint16_t count = TADCSampler::Take(Channel, sum);
+            if (count != 0) {
+                int64_t value = (int64_t)sum * fixed3_t::TConstants::MULTIPLIER / ((int64_t)count * TADCSampler::GetMaxValue());
+                Analog.Value = fixed3_t::FromRaw((int32_t)value) * Coefficient;
+                Updated = context.Now;
+                if (Env::SensorsSendValues) {
+                    context.Send(this, Owner, new AW::TEventSensorData(*this, Analog));
+                }
+            }
         }
-		event->NotBefore = context.Now + Env::SensorsPeriod;
-		context.Resend(this, event.Release());
+        event->NotBefore = context.Now + Env::SensorsPeriod;
+        context.Resend(this, event.Release());
     }
 };
 
-}
\ No newline at end of file
+}
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "aw.h"
+#include "SensorBMx280Compensation.h"
 
 namespace AW {
 
@@ -368,21 +369,9 @@ protected:
                 int32_t t_fine = 0;
                 uint24_t temp;
                 if (Env::Wire::ReadValueLE(Address, ERegisters::REGISTER_TEMPDATA, temp) && temp != 0x800000) {
-                    int32_t var1, var2;
                     int32_t adc_T = temp;
-                    adc_T >>= 4;
-
-                    var1 = ((((adc_T >> 3) - ((int32_t)Calib.dig_T1 << 1))) *
-                        ((int32_t)Calib.dig_T2)) >> 11;
-
-                    var2 = (((((adc_T >> 4) - ((int32_t)Calib.dig_T1)) *
-                        ((adc_T >> 4) - ((int32_t)Calib.dig_T1))) >> 12) *
-                        ((int32_t)Calib.dig_T3)) >> 14;
-
-                    t_fine = var1 + var2;
-
-                    float T = (t_fine * 5 + 128) >> 8;
-                    Temperature = T / 100;
+                    t_fine = TBMx280Compensation::GetTFine(Calib, adc_T >> 4);
+                    Temperature = TBMx280Compensation::GetTemperature(t_fine);
                     if (Env::SensorsSendValues) {
                         context.Send(this, Owner, new AW::TEventSensorData(*this, Temperature));
                     }
@@ -391,27 +380,10 @@ protected:
                 }
                 uint24_t pressure;
                 if (Env::Wire::ReadValueLE(Address, ERegisters::REGISTER_PRESSUREDATA, pressure) && pressure != 0x800000) {
-                    int64_t var1, var2, p;
                     int32_t adc_P = pressure;
-                    adc_P >>= 4;
-
-                    var1 = ((int64_t)t_fine) - 128000;
-                    var2 = var1 * var1 * (int64_t)Calib.dig_P6;
-                    var2 = var2 + ((var1*(int64_t)Calib.dig_P5) << 17);
-                    var2 = var2 + (((int64_t)Calib.dig_P4) << 35);
-                    var1 = ((var1 * var1 * (int64_t)Calib.dig_P3) >> 8) +
-                        ((var1 * (int64_t)Calib.dig_P2) << 12);
-                    var1 = (((((int64_t)1) << 47) + var1))*((int64_t)Calib.dig_P1) >> 33;
-
-                    if (var1 != 0) {
-                        p = 1048576 - adc_P;
-                        p = (((p << 31) - var2) * 3125) / var1;
-                        var1 = (((int64_t)Calib.dig_P9) * (p >> 13) * (p >> 13)) >> 25;
-                        var2 = (((int64_t)Calib.dig_P8) * p) >> 19;
-
-                        p = ((p + var1 + var2) >> 8) + (((int64_t)Calib.dig_P7) << 4);
-                        float P = (float)p / 256;
-                        Pressure = P / 133.32239; // to mmHg
+                    uint32_t p = TBMx280Compensation::GetPressureQ8(Calib, t_fine, adc_P >> 4);
+                    if (p != TBMx280Compensation::NoPressure) {
+                        Pressure = TBMx280Compensation::GetPressureMmHg(p);
                         if (Env::SensorsSendValues) {
                             context.Send(this, Owner, new AW::TEventSensorData(*this, Pressure));
                         }
@@ -422,24 +394,8 @@ protected:
                 if (ChipID == EChips::BME280) {
                     uint16_t humidity;
                     if (Env::Wire::ReadValue(Address, ERegisters::REGISTER_HUMIDDATA, humidity) && humidity != 0x8000) {
-                        int32_t adc_H = humidity;
-                        int32_t v_x1_u32r;
-
-                        v_x1_u32r = (t_fine - ((int32_t)76800));
-
-                        v_x1_u32r = (((((adc_H << 14) - (((int32_t)Calib.dig_H4) << 20) -
-                            (((int32_t)Calib.dig_H5) * v_x1_u32r)) + ((int32_t)16384)) >> 15) *
-                            (((((((v_x1_u32r * ((int32_t)Calib.dig_H6)) >> 10) *
-                            (((v_x1_u32r * ((int32_t)Calib.dig_H3)) >> 11) + ((int32_t)32768))) >> 10) +
-                                ((int32_t)2097152)) * ((int32_t)Calib.dig_H2) + 8192) >> 14));
-
-                        v_x1_u32r = (v_x1_u32r - (((((v_x1_u32r >> 15) * (v_x1_u32r >> 15)) >> 7) *
-                            ((int32_t)Calib.dig_H1)) >> 4));
-
-                        v_x1_u32r = (v_x1_u32r < 0) ? 0 : v_x1_u32r;
-                        v_x1_u32r = (v_x1_u32r > 419430400) ? 419430400 : v_x1_u32r;
-                        float h = (v_x1_u32r >> 12);
-                        Humidity = h / 1024;
+                        uint32_t h = TBMx280Compensation::GetHumidityQ10(Calib, t_fine, humidity);
+                        Humidity = TBMx280Compensation::GetHumidity(h);
                         if (Env::SensorsSendValues) {
                             context.Send(this, Owner, new AW::TEventSensorData(*this, Humidity));
                         }
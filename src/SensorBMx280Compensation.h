@@ -0,0 +1,88 @@
+#pragma once
+
+#include "aw.h"
+
+namespace AW {
+
+// Bosch integer compensation for BMP280 / BME280 with the results directly in fixed3_t,
+// CalibType is any struct with dig_T1..dig_H6 fields as in the datasheet
+struct TBMx280Compensation {
+    // Pa in Q24.8 to 1/1000 mmHg is p * 10^8 / (256 * 13332239), the division is replaced by the multiplication
+    // by 2^40 / divider rounded up, the product fits 64 bits up to 2^25 (131 kPa)
+    static constexpr uint64_t PressureToMmHgDivider = 3413053184ULL;
+    static constexpr uint64_t PressureToMmHgScale = 100000000ULL;
+    static constexpr uint64_t PressureToMmHg = 32214898758ULL;
+    static constexpr uint8_t PressureToMmHgShift = 40;
+    // returned when the pressure couldn't be calculated (var1 == 0 in the datasheet code)
+    static constexpr uint32_t NoPressure = 0;
+
+    template <typename CalibType>
+    static int32_t GetTFine(const CalibType& calib, int32_t adc_T) {
+        int32_t var1, var2;
+        var1 = ((((adc_T >> 3) - ((int32_t)calib.dig_T1 << 1))) *
+            ((int32_t)calib.dig_T2)) >> 11;
+        var2 = (((((adc_T >> 4) - ((int32_t)calib.dig_T1)) *
+            ((adc_T >> 4) - ((int32_t)calib.dig_T1))) >> 12) *
+            ((int32_t)calib.dig_T3)) >> 14;
+        return var1 + var2;
+    }
+
+    // temperature in 1/100 C is multiplied by 10 to get 1/1000
+    static fixed3_t GetTemperature(int32_t t_fine) {
+        return fixed3_t::FromRaw(((t_fine * 5 + 128) >> 8) * 10);
+    }
+
+    // pressure in Pa as Q24.8, NoPressure if it couldn't be calculated
+    template <typename CalibType>
+    static uint32_t GetPressureQ8(const CalibType& calib, int32_t t_fine, int32_t adc_P) {
+        int64_t var1, var2, p;
+        var1 = ((int64_t)t_fine) - 128000;
+        var2 = var1 * var1 * (int64_t)calib.dig_P6;
+        var2 = var2 + ((var1*(int64_t)calib.dig_P5) << 17);
+        var2 = var2 + (((int64_t)calib.dig_P4) << 35);
+        var1 = ((var1 * var1 * (int64_t)calib.dig_P3) >> 8) +
+            ((var1 * (int64_t)calib.dig_P2) << 12);
+        var1 = (((((int64_t)1) << 47) + var1))*((int64_t)calib.dig_P1) >> 33;
+        if (var1 == 0) {
+            return NoPressure;
+        }
+        p = 1048576 - adc_P;
+        p = (((p << 31) - var2) * 3125) / var1;
+        var1 = (((int64_t)calib.dig_P9) * (p >> 13) * (p >> 13)) >> 25;
+        var2 = (((int64_t)calib.dig_P8) * p) >> 19;
+        return (uint32_t)(((p + var1 + var2) >> 8) + (((int64_t)calib.dig_P7) << 4));
+    }
+
+    // truncated as the exact quotient, the rounded up multiplier overshoots by one near the integer results
+    static fixed3_t GetPressureMmHg(uint32_t pressure) {
+        uint32_t result = (uint32_t)((pressure * PressureToMmHg) >> PressureToMmHgShift);
+        if (result * PressureToMmHgDivider > pressure * PressureToMmHgScale) {
+            --result;
+        }
+        return fixed3_t::FromRaw((int32_t)result);
+    }
+
+    // humidity in %RH as Q22.10
+    template <typename CalibType>
+    static uint32_t GetHumidityQ10(const CalibType& calib, int32_t t_fine, int32_t adc_H) {
+        int32_t v_x1_u32r;
+        v_x1_u32r = (t_fine - ((int32_t)76800));
+        v_x1_u32r = (((((adc_H << 14) - (((int32_t)calib.dig_H4) << 20) -
+            (((int32_t)calib.dig_H5) * v_x1_u32r)) + ((int32_t)16384)) >> 15) *
+            (((((((v_x1_u32r * ((int32_t)calib.dig_H6)) >> 10) *
+            (((v_x1_u32r * ((int32_t)calib.dig_H3)) >> 11) + ((int32_t)32768))) >> 10) +
+                ((int32_t)2097152)) * ((int32_t)calib.dig_H2) + 8192) >> 14));
+        v_x1_u32r = (v_x1_u32r - (((((v_x1_u32r >> 15) * (v_x1_u32r >> 15)) >> 7) *
+            ((int32_t)calib.dig_H1)) >> 4));
+        v_x1_u32r = (v_x1_u32r < 0) ? 0 : v_x1_u32r;
+        v_x1_u32r = (v_x1_u32r > 419430400) ? 419430400 : v_x1_u32r;
+        return (uint32_t)(v_x1_u32r >> 12);
+    }
+
+    // 1000 / 1024 = 125 / 128
+    static fixed3_t GetHumidity(uint32_t humidity) {
+        return fixed3_t::FromRaw((int32_t)((humidity * 125) >> 7));
+    }
+};
+
+}
@@ -1,36 +1,41 @@
 #pragma once
 
-#include "ArduinoWorkflow.h"
-#include <EmonLib.h>
+#include "aw.h"
+#include "aw-adc.h"
+#include "aw-rms.h"
 
 namespace AW {
 
+// current transformer, RMS is accumulated in background by TADCSampler over whole mains cycles,
+// the actor only publishes the latest result, so any number of CT pins are sampled at once
+// Calibration is the same as EmonLib's ICAL: amperes of primary current per volt on the burden resistor
 template <uint8_t Pin, typename Env = TDefaultEnvironment>
-class TSensorCT : public TActor {
+class TSensorCT : public TActor, public TSensorSource {
 public:
     TActor* Owner;
-    TSensor<1> Sensor;
-
-    enum ESensor {
-        Current
-    };
+    TSensorValueFixed3 Current;
+    fixed3_t Calibration = fixed3_t(111.1);
 
     TSensorCT(TActor* owner, StringBuf name = "ct")
         : Owner(owner)
+        , RMS(TADCSampler::GetMaxValue())
+        , Channel(TADCSampler::AddChannel(Pin, &TRMSAccumulator::OnSample, &RMS))
     {
-		EMon.current(Pin, 111.1);
-        Sensor.Name = name;
-        Sensor.Values[ESensor::Current].Name = "current";
+        Name = name;
+        Current.Name = "current";
     }
 
-	void Calibrate(double calibration, unsigned int samples) {
-		EMon.current(Pin, calibration);
-		Samples = samples;
-	}
+    // cycles is the number of mains periods in one RMS window
+    void Calibrate(fixed3_t calibration, uint8_t cycles = 10) {
+        Calibration = calibration;
+        RMS.Cycles = cycles;
+    }
 
 protected:
-    EnergyMonitor EMon;
-	unsigned int Samples = 1480;
+    static constexpr uint32_t ReferenceMilliVolts = (uint32_t)(ArduinoSettings::GetReferenceVoltage() * 1000 + 0.5f);
+
+    TRMSAccumulator RMS;
+    int8_t Channel;
 
     void OnEvent(TEventPtr event, const TActorContext& context) override {
         switch (event->EventID) {
@@ -38,23 +43,33 @@ protected:
             return OnBootstrap(static_cast<TEventBootstrap*>(event.Release()), context);
         case TEventReceive::EventID:
             return OnReceive(static_cast<TEventReceive*>(event.Release()), context);
+        default:
+            break;
         }
     }
 
     void OnBootstrap(TUniquePtr<TEventBootstrap>, const TActorContext& context) {
+        // the RMS windows should cover whole mains cycles, so the ADC is kept running through the standby
+        TADCSampler::Begin(context.ActorLib);
         context.Send(this, this, new AW::TEventReceive(context.Now + Env::SensorsPeriod));
     }
 
     void OnReceive(AW::TUniquePtr<AW::TEventReceive> event, const AW::TActorContext& context) {
-        Sensor.Values[ESensor::Current].Value = EMon.calcIrms(Samples);
-        Sensor.Updated = context.Now;
-		if (Env::SensorsSendValues) {
-			context.Send(this, Owner, new AW::TEventSensorData(Sensor, Sensor.Values[ESensor::Current]));
-		}
-        //context.ResendAfter(this, event.Release(), Env::SensorsPeriod);
-		event->NotBefore = context.Now + Env::SensorsPeriod;
-		context.Resend(this, event.Release());
+        TADCSampler::Poll();
+        uint32_t rms;
+        if (Channel >= 0 && RMS.Take(rms)) {
+            // rms is Q8 of ADC units, Irms = rms * Vref / (MaxValue + 1) * Calibration
+            int64_t value = (int64_t)rms * ReferenceMilliVolts * Calibration.raw()
+                / ((int64_t)(TADCSampler::GetMaxValue() + 1) * 256 * 1000);
+            Current.Value = fixed3_t::FromRaw((int32_t)value);
+            Updated = context.Now;
+            if (Env::SensorsSendValues) {
+                context.Send(this, Owner, new AW::TEventSensorData(*this, Current));
+            }
+        }
+        event->NotBefore = context.Now + Env::SensorsPeriod;
+        context.Resend(this, event.Release());
     }
 };
 
-}
\ No newline at end of file
+}
@@ -1,121 +1,193 @@
 #pragma once
 
 #include "aw.h"
+#include "aw-interrupt.h"
 
 namespace AW {
 
-template <uint8_t Pin, typename Env = TDefaultEnvironment>
-class TSensorInterruptCounter : public TActor, public TSensorSource {
+// pulse counter shared by the interrupt (or the polling) and the actor, timestamps are microseconds of the counter's clock,
+// a pulse closer than Debounce to the last counted one is a contact bounce and is ignored
+class TPulseCounter {
+public:
+    uint32_t Debounce; // us
+
+    struct TSnapshot {
+        uint32_t Pulses;
+        uint32_t LastTime;
+        uint32_t Interval;
+    };
+
+    explicit TPulseCounter(uint32_t debounce)
+        : Debounce(debounce)
+    {}
+
+    void OnPulse(uint32_t now) {
+        if (Pulses != 0) {
+            uint32_t interval = now - LastTime;
+            if (interval < Debounce) {
+                return;
+            }
+            Interval = interval;
+        }
+        LastTime = now;
+        ++Pulses;
+    }
+
+    TSnapshot Get() const {
+        noInterrupts();
+        TSnapshot snapshot = {Pulses, LastTime, Interval};
+        interrupts();
+        return snapshot;
+    }
+
+protected:
+    volatile uint32_t Pulses = 0;
+    volatile uint32_t LastTime = 0;
+    volatile uint32_t Interval = 0; // between the last two pulses
+};
+
+// common part of the counters, every SensorsPeriod it reports the total,
+// the instantaneous rate (by the interval between the last two pulses, decaying while the next one is late)
+// and the average rate since the last report, rates are pulses per minute
+template <typename Env>
+class TSensorCounterBase : public TActor, public TSensorSource {
 public:
     TActor* Owner;
     TSensorValueULong Sensor;
-    /*volatile */uint32_t Value = 0;
+    TSensorValueFixed3 Rate;
+    TSensorValueFixed3 AverageRate;
 
-    TSensorInterruptCounter(TActor* owner, StringBuf name = "counter")
+    TSensorCounterBase(TActor* owner, StringBuf name, uint32_t debounce)
         : Owner(owner)
-        , PinValue(INPUT_PULLUP)
+        , Counter(debounce)
     {
         Name = name;
         Sensor.Name = "counter";
+        Rate.Name = "rate";
+        AverageRate.Name = "rate.average";
+    }
 
+    uint32_t GetValue() const {
+        return Counter.Get().Pulses;
     }
 
 protected:
-    static constexpr TTime MinDelayLow = TTime::MilliSeconds(500);
-    static constexpr TTime MinDelayHigh = TTime::MilliSeconds(500);
+    // fixed3 pulses per minute from microseconds
+    static constexpr int64_t RateMultiplier = 60LL * 1000000 * 1000;
+
+    TPulseCounter Counter;
+    uint32_t LastPulses = 0;
+    int64_t LastRate = -1;
+    TTime LastPulseTime;
+    TTime LastReport;
+
+    void Start(const TActorContext& context) {
+        LastPulseTime = LastReport = context.Now;
+    }
+
+    // now is in the clock of the pulse timestamps
+    void Report(const TActorContext& context, uint32_t now) {
+        TPulseCounter::TSnapshot snapshot = Counter.Get();
+        uint32_t pulses = snapshot.Pulses - LastPulses;
+        if (pulses != 0) {
+            LastPulseTime = context.Now;
+        }
+        int64_t rate = 0;
+        // the microseconds wrap in ~71 minutes, the interval to the last pulse is meaningless after that
+        if (snapshot.Pulses >= 2 && context.Now - LastPulseTime < TTime::Minutes(30)) {
+            uint32_t interval = now - snapshot.LastTime;
+            if (interval < snapshot.Interval) {
+                interval = snapshot.Interval;
+            }
+            rate = RateMultiplier / interval;
+        }
+        unsigned long period = (context.Now - LastReport).MilliSeconds();
+        bool changed = pulses != 0 || rate != LastRate;
+        Sensor.SetValue(snapshot.Pulses);
+        Rate.Value = fixed3_t::FromRaw((int32_t)rate);
+        if (period != 0) {
+            AverageRate.Value = fixed3_t::FromRaw((int32_t)((int64_t)pulses * RateMultiplier / 1000 / period));
+        }
+        LastPulses = snapshot.Pulses;
+        LastRate = rate;
+        LastReport = context.Now;
+        if (changed) {
+            Updated = context.Now;
+            if (Env::SensorsSendValues) {
+                context.Send(this, Owner, new TEventSensorData(*this, Sensor));
+                context.Send(this, Owner, new TEventSensorData(*this, Rate));
+                context.Send(this, Owner, new TEventSensorData(*this, AverageRate));
+            }
+        }
+    }
+};
+
+// counts the pulses in the pin interrupt, any number of counters could be used (up to TPinInterrupts::MaxSlots),
+// Mode is the counted edge, the pulses are timed by micros(), which stops in the standby,
+// so the counter holds a standby lock, the CPU only idles between the events and the EIC keeps running
+template <uint8_t Pin, typename Env = TDefaultEnvironment>
+class TSensorInterruptCounter : public TSensorCounterBase<Env> {
+    using TBase = TSensorCounterBase<Env>;
+public:
+    int Mode = RISING;
+
+    TSensorInterruptCounter(TActor* owner, StringBuf name = "counter", uint32_t debounce = 500000)
+        : TBase(owner, name, debounce)
+        , PinValue(INPUT_PULLUP)
+    {}
+
+protected:
     TDigitalPin<Pin> PinValue;
-    /*volatile */bool LastValue;
-    /*volatile */TTime LastTime;
-    /*volatile */TTime Low;
-    /*volatile */TTime High;
-    
+
     void OnEvent(TEventPtr event, const TActorContext& context) override {
         switch (event->EventID) {
         case TEventBootstrap::EventID:
             return OnBootstrap(static_cast<TEventBootstrap*>(event.Release()), context);
         case TEventReceive::EventID:
             return OnReceive(static_cast<TEventReceive*>(event.Release()), context);
+        default:
+            break;
         }
     }
 
     void OnBootstrap(TUniquePtr<TEventBootstrap>, const TActorContext& context) {
-        This() = this;
-        LastValue = PinValue;
-        LastTime = context.Now;
-        attachInterrupt(digitalPinToInterrupt(PinValue.GetPin()), StaticInterrupt, CHANGE);
-        context.Send(this, this, new TEventReceive());
+        TBase::Start(context);
+        if (TPinInterrupts::Attach(PinValue.GetPin(), Mode, StaticInterrupt, this, true)) {
+            ++context.ActorLib.StandbyLocks;
+        } else if (Env::Diagnostics) {
+            context.Send(this, TBase::Owner, new TEventSensorMessage(*this, StringStream() << "No free interrupt slot"));
+        }
+        context.Send(this, this, new TEventReceive(context.Now + Env::SensorsPeriod));
     }
 
     void OnReceive(TUniquePtr<TEventReceive> event, const TActorContext& context) {
-        if (Value != Sensor.GetValue()) {
-            Sensor.SetValue(Value);
-            Updated = context.Now;
-            if (Env::SensorsSendValues) {
-                context.Send(this, Owner, new TEventSensorData(*this, Sensor));
-            }
-        }
+        TBase::Report(context, micros());
         event->NotBefore = context.Now + Env::SensorsPeriod;
         context.Resend(this, event.Release());
     }
 
-    void Interrupt() {
-        bool value = PinValue;
-        if (value != LastValue) {
-            TTime now = TTime::Now();
-            TTime delay = now - LastTime;
-            switch (value) {
-            case false:
-                if (delay < MinDelayLow) {
-                    LastValue = value;
-                    return;
-                }
-                High = now;
-                break;
-            case true:
-                if (delay < MinDelayHigh) {
-                    LastValue = value;
-                    return;
-                }
-                Low = now;
-                ++Value;
-                break;
-            }
-            LastTime = now;
-            LastValue = value;
-        }
-    }
-
-    static TSensorInterruptCounter*& This() { static TSensorInterruptCounter* _this; return _this; }
-
-    static void StaticInterrupt() {
-        This()->Interrupt();
+    static void StaticInterrupt(void* context) {
+        static_cast<TSensorInterruptCounter*>(context)->Counter.OnPulse(micros());
     }
 };
 
+// counts the pulses by polling the pin every Resolution, for pins without interrupts,
+// pulses shorter than Resolution are missed, they are timed by the actor time, which goes on in the sleep between the polls
 template <uint8_t Pin, typename Env = TDefaultEnvironment>
-class TSensorPollingCounter : public TActor, public TSensorSource {
+class TSensorPollingCounter : public TSensorCounterBase<Env> {
+    using TBase = TSensorCounterBase<Env>;
 public:
-    TActor * Owner;
-    TSensorValueULong Sensor;
-    uint32_t Value = 0;
+    int Mode = RISING;
+    TTime Resolution = TTime::MilliSeconds(50);
 
-    TSensorPollingCounter(TActor* owner, StringBuf name = "counter")
-        : Owner(owner)
+    TSensorPollingCounter(TActor* owner, StringBuf name = "counter", uint32_t debounce = 500000)
+        : TBase(owner, name, debounce)
         , PinValue(INPUT_PULLUP)
-    {
-        Name = name;
-        Sensor.Name = "counter";
-    }
+    {}
 
 protected:
-    static constexpr TTime MinDelayLow = TTime::MilliSeconds(500);
-    static constexpr TTime MinDelayHigh = TTime::MilliSeconds(500);
-    static constexpr TTime Resolution = TTime::MilliSeconds(50);
     TDigitalPin<Pin> PinValue;
     bool LastValue;
-    TTime LastTime;
-    TTime Low;
-    TTime High;
 
     void OnEvent(TEventPtr event, const TActorContext& context) override {
         switch (event->EventID) {
@@ -129,47 +201,29 @@ protected:
     }
 
     void OnBootstrap(TUniquePtr<TEventBootstrap>, const TActorContext& context) {
+        TBase::Start(context);
         LastValue = PinValue;
-        LastTime = context.Now;
         context.Send(this, this, new TEventReceive());
     }
 
     void OnReceive(TUniquePtr<TEventReceive> event, const TActorContext& context) {
         bool value = PinValue;
         if (value != LastValue) {
-            TTime now = context.Now;
-            TTime delay = now - LastTime;
-            switch ((int)value) {
-            case false:
-                if (delay < MinDelayLow) {
-                    LastValue = value;
-                    break;
-                }
-                High = now;
-                break;
-            case true:
-                if (delay < MinDelayHigh) {
-                    LastValue = value;
-                    break;
-                }
-                Low = now;
-                ++Value;
-                break;
+            if (Mode == CHANGE || (Mode == RISING) == value) {
+                TBase::Counter.OnPulse(GetMicros(context));
             }
-            LastTime = now;
             LastValue = value;
         }
-        if (Value != Sensor.GetValue()) {
-            Sensor.SetValue(Value);
-            Updated = context.Now;
-            if (Env::SensorsSendValues) {
-                context.Send(this, Owner, new TEventSensorData(*this, Sensor));
-            }
+        if (context.Now - TBase::LastReport >= Env::SensorsPeriod) {
+            TBase::Report(context, GetMicros(context));
         }
         event->NotBefore = context.Now + Resolution;
         context.Resend(this, event.Release());
     }
-};
 
+    static uint32_t GetMicros(const TActorContext& context) {
+        return context.Now.MilliSeconds() * 1000;
+    }
+};
 
 }
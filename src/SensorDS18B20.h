@@ -1,6 +1,7 @@
 #pragma once
 
 #include "aw.h"
+#include "aw-files.h"
 //#include <OneWire.h>
 
 #define REQUIRESALARMS false
@@ -9,30 +10,46 @@
 
 namespace AW {
 
-template <typename Env = TDefaultEnvironment>
-class TSensorDS18B20 : public TActor {
+// all DS18B20 probes on one pin, ROM codes are enumerated once at bootstrap (or taken from the file system),
+// DallasTemperature::begin() isn't used, it searches the whole bus too,
+// one broadcast conversion is requested for all of them and every probe is read by its ROM,
+// each probe is a separate value named by its ROM code in hex
+template <typename Env = TDefaultEnvironment, uint8_t MaxDevices = 20>
+class TSensorDS18B20 : public TActor, public TSensorSource {
 public:
     TActor* Owner;
-    TSensor<1> Sensor;
-
-    enum ESensor {
-        Temperature,
-    };
+    IFileSystem* FileSystem = nullptr;
+    TSensorValueFixed3 Temperatures[MaxDevices];
 
     TSensorDS18B20(uint8_t oneWirePin, TActor* owner, StringBuf name = "ds18b20")
         : Owner(owner)
         , OneWireBus(oneWirePin)
         , DS(&OneWireBus)
     {
-        Sensor.Name = name;
-        Sensor.Values[ESensor::Temperature].Name = "temperature";
+        Name = name;
+    }
+
+    uint8_t GetDeviceCount() const {
+        return DeviceCount;
     }
 
 protected:
+    static constexpr uint8_t ROMSize = 8;
+    // 1/128 C to 1/1000 C
+    static constexpr int32_t RawToFixed3Multiplier = 125;
+    static constexpr int32_t RawToFixed3Divider = 16;
+    static constexpr uint8_t CommandConvert = 0x44;
+    static constexpr uint8_t CommandReadPowerSupply = 0xb4;
+
     OneWire OneWireBus;
     DallasTemperature DS;
     TTime ConversionPeriod;
+    TTime ConversionDeadline;
     bool Requested = false;
+    bool Parasite = false;
+    uint8_t DeviceCount = 0;
+    DeviceAddress ROMs[MaxDevices];
+    char ROMNames[MaxDevices][ROMSize * 2];
 
     void OnEvent(TEventPtr event, const TActorContext& context) override {
         switch (event->EventID) {
@@ -45,35 +62,135 @@ protected:
         }
     }
 
+    String GetFileName() const {
+        return Name + StringBuf(".roms");
+    }
+
+    bool LoadROMs() {
+        if (FileSystem == nullptr) {
+            return false;
+        }
+        String data;
+        if (!FileSystem->ReadFile(GetFileName(), data) || data.size() == 0 || data.size() % ROMSize != 0 || data.size() / ROMSize > MaxDevices) {
+            return false;
+        }
+        DeviceCount = (uint8_t)(data.size() / ROMSize);
+        for (uint8_t i = 0; i < DeviceCount; ++i) {
+            memcpy(ROMs[i], data.data() + i * ROMSize, ROMSize);
+            if (OneWire::crc8(ROMs[i], ROMSize - 1) != ROMs[i][ROMSize - 1]) {
+                DeviceCount = 0;
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // the only full bus search, every getAddress() walks the bus from the start
+    void EnumerateROMs() {
+        DeviceCount = 0;
+        OneWireBus.reset_search();
+        while (DeviceCount < MaxDevices && OneWireBus.search(ROMs[DeviceCount])) {
+            if (OneWire::crc8(ROMs[DeviceCount], ROMSize - 1) == ROMs[DeviceCount][ROMSize - 1] && DS.validFamily(ROMs[DeviceCount])) {
+                ++DeviceCount;
+            }
+        }
+        if (FileSystem != nullptr && DeviceCount != 0) {
+            FileSystem->WriteFile(GetFileName(), StringBuf(reinterpret_cast<const char*>(ROMs), DeviceCount * ROMSize));
+        }
+    }
+
+    // what DallasTemperature::begin() learns from its bus search: the power mode and the conversion time of the slowest probe
+    void SetupBus() {
+        OneWireBus.reset();
+        OneWireBus.skip();
+        OneWireBus.write(CommandReadPowerSupply);
+        Parasite = OneWireBus.read_bit() == 0;
+        uint8_t resolution = 9;
+        for (uint8_t i = 0; i < DeviceCount; ++i) {
+            uint8_t probe = DS.getResolution(ROMs[i]);
+            if (probe > resolution) {
+                resolution = probe;
+            }
+        }
+        ConversionPeriod = TTime::MilliSeconds(DS.millisToWaitForConversion(resolution));
+    }
+
+    void RequestConversion() {
+        OneWireBus.reset();
+        OneWireBus.skip();
+        // the parasite powered probes take the current from the strong pull-up during the conversion
+        OneWireBus.write(CommandConvert, Parasite);
+    }
+
+    // a parasite powered probe can't signal the end, it's done after the conversion time
+    bool IsConversionComplete() {
+        return Parasite || OneWireBus.read_bit() == 1;
+    }
+
+    void NameValues() {
+        static constexpr char Hex[] = "0123456789abcdef";
+        for (uint8_t i = 0; i < DeviceCount; ++i) {
+            for (uint8_t j = 0; j < ROMSize; ++j) {
+                ROMNames[i][j * 2] = Hex[ROMs[i][j] >> 4];
+                ROMNames[i][j * 2 + 1] = Hex[ROMs[i][j] & 0x0f];
+            }
+            Temperatures[i].Name = StringBuf(ROMNames[i], ROMSize * 2);
+        }
+    }
+
     void OnBootstrap(TUniquePtr<TEventBootstrap>, const TActorContext& context) {
-        DS.begin();
-        DS.setWaitForConversion(false);
-        ConversionPeriod = TTime::MilliSeconds(DS.millisToWaitForConversion(DS.getResolution()));
+        bool cached = LoadROMs();
+        if (!cached) {
+            EnumerateROMs();
+        }
+        SetupBus();
+        NameValues();
         context.Send(this, this, new AW::TEventReceive());
         if (Env::Diagnostics) {
-            context.Send(this, Owner, new TEventSensorMessage(Sensor, StringStream() << "DS18B20"));
+            context.Send(this, Owner, new TEventSensorMessage(*this, StringStream() << "DS18B20 x" << DeviceCount << (cached ? " (cached)" : "")));
         }
     }
 
     void OnReceive(TUniquePtr<TEventReceive> event, const TActorContext& context) {
-        if (Requested && DS.isConversionComplete()) {
+        if (Requested) {
+            if (!IsConversionComplete() && context.Now < ConversionDeadline) {
+                // checked again, a new request would restart the conversion
+                event->NotBefore = context.Now + TTime::MilliSeconds(ConversionPeriod.MilliSeconds() / 8);
+                context.Resend(this, event.Release());
+                return;
+            }
             Requested = false;
-            auto temp = DS.getTempCByIndex(0);
-            if (temp != DEVICE_DISCONNECTED_C) {
-                Sensor.Values[ESensor::Temperature].Value = temp;
-                Sensor.Updated = context.Now;
-                if (Env::SensorsSendValues) {
-                    context.Send(this, Owner, new TEventSensorData(Sensor, Sensor.Values[ESensor::Temperature]));
+            uint8_t good = 0;
+            for (uint8_t i = 0; i < DeviceCount; ++i) {
+                int16_t raw = DS.getTemp(ROMs[i]);
+                if (raw != DEVICE_DISCONNECTED_RAW) {
+                    Temperatures[i].Value = fixed3_t::FromRaw((int32_t)raw * RawToFixed3Multiplier / RawToFixed3Divider);
+                    ++good;
+                    if (Env::SensorsSendValues) {
+                        context.Send(this, Owner, new TEventSensorData(*this, Temperatures[i]));
+                    }
+                } else {
+                    Temperatures[i].Value.Clear();
                 }
             }
+            if (good != 0) {
+                Updated = context.Now;
+            } else {
+                // the probes were replaced or the cache is stale
+                EnumerateROMs();
+                SetupBus();
+                NameValues();
+            }
             event->NotBefore = context.Now + Env::SensorsPeriod;
         } else {
             Requested = true;
-            DS.requestTemperatures();
+            RequestConversion(); // one broadcast (skip ROM) conversion for all probes
+            // a probe which doesn't finish in twice the datasheet time is read anyway, it's reported as disconnected
+            ConversionDeadline = context.Now + ConversionPeriod * 2;
             event->NotBefore = context.Now + ConversionPeriod;
         }
         context.Resend(this, event.Release());
     }
 };
 
-}
\ No newline at end of file
+}
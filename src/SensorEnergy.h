@@ -1,25 +1,66 @@
 #pragma once
 
-#include "ArduinoWorkflow.h"
-#include <EmonLib.h>
+#include "aw.h"
+#include "aw-adc.h"
+#include "aw-rms.h"
+#include "aw-files.h"
 
 namespace AW {
 
-class TSensorEnergy : public TActor {
+// mains energy meter, voltage and current are sampled in background by TADCSampler,
+// the actor reports voltage, current, real / apparent power, power factor and the energy counter,
+// the energy is integrated from the average real power of all samples between the reports,
+// whole watt-hours are persisted in the file system (if any) every SavePeriod
+// calibrations are the same as EmonLib's VCAL / ICAL, phase calibration is Q8 (PHASECAL * 256)
+// without two free TADCSampler channels the meter stays idle
+template <typename Env = TDefaultEnvironment>
+class TSensorEnergy : public TActor, public TSensorSource {
 public:
     TActor* Owner;
-    TTime Period = AW::TTime::MilliSeconds(10000);
-    bool SendValues = true;
+    TTime Period = AW::TTime::Seconds(10);
+    TTime SavePeriod = AW::TTime::Minutes(10);
+    IFileSystem* FileSystem = nullptr;
+    TSensorValueFixed3 Voltage;
+    TSensorValueFixed3 Current;
+    TSensorValueFixed3 RealPower;
+    TSensorValueFixed3 ApparentPower;
+    TSensorValueFixed3 PowerFactor;
+    TSensorValueFixed3 Energy; // kWh
 
-    TSensorEnergy(TActor* owner, uint8_t vPin, double vCal, double phaseCal, uint8_t iPin, double iCal)
+    TSensorEnergy(TActor* owner, uint8_t vPin, fixed3_t vCal, int16_t phaseCal, uint8_t iPin, fixed3_t iCal, StringBuf name = "energy")
         : Owner(owner)
+        , VoltageCalibration(vCal)
+        , CurrentCalibration(iCal)
+        , Power(TADCSampler::GetMaxValue(), phaseCal)
     {
-        EMon.voltage(vPin, vCal, phaseCal);
-        EMon.current(iPin, iCal);
+        // V and I channels must be consecutive, V first, so both are added or none
+        if (TADCSampler::GetFreeChannels() >= 2) {
+            Channel = TADCSampler::AddChannel(vPin, &TPowerAccumulator::OnVoltage, &Power);
+            TADCSampler::AddChannel(iPin, &TPowerAccumulator::OnCurrent, &Power);
+        }
+        Name = name;
+        Voltage.Name = "voltage";
+        Current.Name = "current";
+        RealPower.Name = "power";
+        ApparentPower.Name = "apparent";
+        PowerFactor.Name = "pf";
+        Energy.Name = "energy";
     }
 
 protected:
-    EnergyMonitor EMon;
+    static constexpr uint32_t ReferenceMilliVolts = (uint32_t)(ArduinoSettings::GetReferenceVoltage() * 1000 + 0.5f);
+    // mW * ms in one Wh
+    static constexpr int64_t MicroJoulesPerWattHour = 3600000000LL;
+
+    fixed3_t VoltageCalibration;
+    fixed3_t CurrentCalibration;
+    TPowerAccumulator Power;
+    int8_t Channel = -1; // of the voltage, the current is the next one
+    int32_t WattHours = 0;
+    int32_t SavedWattHours = 0;
+    int64_t MicroJoules = 0;
+    TTime LastTime;
+    TTime LastSave;
 
     void OnEvent(TEventPtr event, const TActorContext& context) override {
         switch (event->EventID) {
@@ -27,22 +68,72 @@ protected:
             return OnBootstrap(static_cast<TEventBootstrap*>(event.Release()), context);
         case TEventReceive::EventID:
             return OnReceive(static_cast<TEventReceive*>(event.Release()), context);
+        default:
+            break;
         }
     }
 
+    // ADC units to 1/1000 of the calibrated unit
+    static int64_t Scale(int64_t value, fixed3_t calibration) {
+        return value * ReferenceMilliVolts * calibration.raw() / ((int64_t)(TADCSampler::GetMaxValue() + 1) * 1000);
+    }
+
+    // ADC units^2 (Q8) to mW
+    int64_t GetPower(int64_t power) const {
+        return Scale(Scale(power, VoltageCalibration) / 256, CurrentCalibration) / 1000;
+    }
+
     void OnBootstrap(TUniquePtr<TEventBootstrap>, const TActorContext& context) {
-        EMon.calcVI(100, 1000);
+        if (FileSystem != nullptr) {
+            WattHours = SavedWattHours = FileSystem->ReadValue<long>(Name + StringBuf(".energy"));
+        }
+        if (Channel < 0) {
+            return;
+        }
+        // the energy is integrated over the whole time (with the sleep), so it's sampled through the standby too
+        TADCSampler::Begin(context.ActorLib);
+        LastTime = LastSave = context.Now;
         context.Send(this, this, new AW::TEventReceive(context.Now + Period));
     }
 
     void OnReceive(AW::TUniquePtr<AW::TEventReceive> event, const AW::TActorContext& context) {
-        EMon.calcVI(100, 1000);
-        //context.Send(this, Owner, new AW::TEventSensorData("energy.power", EMon.apparentPower));
-        //context.Send(this, Owner, new AW::TEventSensorData("energy.voltage", EMon.Vrms));
-        //context.Send(this, Owner, new AW::TEventSensorData("energy.current", EMon.Irms));
+        TADCSampler::Poll();
+        TPowerAccumulator::TResult result;
+        if (Power.Take(result)) {
+            fixed3_t voltage = fixed3_t::FromRaw((int32_t)(Scale(result.VoltageRMS, VoltageCalibration) / 256));
+            fixed3_t current = fixed3_t::FromRaw((int32_t)(Scale(result.CurrentRMS, CurrentCalibration) / 256));
+            fixed3_t realPower = fixed3_t::FromRaw((int32_t)GetPower(result.Power));
+            fixed3_t apparentPower = voltage * current;
+            Voltage.Value = voltage;
+            Current.Value = current;
+            RealPower.Value = realPower;
+            ApparentPower.Value = apparentPower;
+            PowerFactor.Value = apparentPower.raw() != 0 ? realPower / apparentPower : fixed3_t(0);
+            MicroJoules += GetPower(result.AveragePower) * (int64_t)(context.Now - LastTime).MilliSeconds();
+            int32_t wattHours = (int32_t)(MicroJoules / MicroJoulesPerWattHour);
+            WattHours += wattHours;
+            MicroJoules -= wattHours * MicroJoulesPerWattHour;
+            Energy.Value = fixed3_t::FromRaw(WattHours);
+            LastTime = context.Now;
+            Updated = context.Now;
+            if (Env::SensorsSendValues) {
+                context.Send(this, Owner, new AW::TEventSensorData(*this, Voltage));
+                context.Send(this, Owner, new AW::TEventSensorData(*this, Current));
+                context.Send(this, Owner, new AW::TEventSensorData(*this, RealPower));
+                context.Send(this, Owner, new AW::TEventSensorData(*this, ApparentPower));
+                context.Send(this, Owner, new AW::TEventSensorData(*this, PowerFactor));
+                context.Send(this, Owner, new AW::TEventSensorData(*this, Energy));
+            }
+        }
+        if (FileSystem != nullptr && WattHours != SavedWattHours && context.Now - LastSave >= SavePeriod) {
+            if (FileSystem->WriteValue(Name + StringBuf(".energy"), (long)WattHours)) {
+                SavedWattHours = WattHours;
+            }
+            LastSave = context.Now;
+        }
         event->NotBefore = context.Now + Period;
         context.Resend(this, event.Release());
     }
 };
 
-}
\ No newline at end of file
+}
@@ -0,0 +1,88 @@
+#pragma once
+
+#include "aw.h"
+#include "aw-frequency.h"
+
+namespace AW {
+
+// frequency (Hz) and period (us) of a pulse input, counted by TFrequencyCounter in hardware,
+// the gate is the report period (SensorsPeriod), the edges are counted over it and timed by micros(),
+// the counter is read every PollPeriod only to extend it, so the input is limited to 65535 edges per PollPeriod,
+// the TC (clocked by GCLK0) and micros() stop in the standby, so the sensor holds a standby lock while it counts
+template <typename Env = TDefaultEnvironment>
+class TSensorFrequency : public TActor, public TSensorSource {
+public:
+    TActor* Owner;
+    TTime PollPeriod = TTime::MilliSeconds(100);
+    TFrequencyCounter Counter;
+    TSensorValueFixed3 Frequency;
+    TSensorValueFixed3 Period;
+
+    TSensorFrequency(uint8_t pin, TActor* owner, StringBuf name = "frequency", uint8_t timer = 3, uint8_t channel = 0)
+        : Owner(owner)
+        , Counter(pin, timer, channel)
+    {
+        Name = name;
+        Frequency.Name = "frequency";
+        Period.Name = "period";
+    }
+
+protected:
+    uint32_t GateEdges = 0;
+    uint32_t GateTime = 0;
+    TTime LastReport;
+
+    void OnEvent(TEventPtr event, const TActorContext& context) override {
+        switch (event->EventID) {
+        case TEventBootstrap::EventID:
+            return OnBootstrap(static_cast<TEventBootstrap*>(event.Release()), context);
+        case TEventReceive::EventID:
+            return OnReceive(static_cast<TEventReceive*>(event.Release()), context);
+        default:
+            break;
+        }
+    }
+
+    void OnBootstrap(TUniquePtr<TEventBootstrap>, const TActorContext& context) {
+        if (!Counter.Begin()) {
+            if (Env::Diagnostics) {
+                context.Send(this, Owner, new TEventSensorMessage(*this, StringStream() << "Failed to start the counter"));
+            }
+            return;
+        }
+        ++context.ActorLib.StandbyLocks;
+        GateEdges = Counter.Read();
+        GateTime = micros();
+        LastReport = context.Now;
+        context.Send(this, this, new TEventReceive(context.Now + PollPeriod));
+    }
+
+    void OnReceive(TUniquePtr<TEventReceive> event, const TActorContext& context) {
+        uint32_t edges = Counter.Read();
+        uint32_t now = micros();
+        if (context.Now - LastReport >= Env::SensorsPeriod) {
+            uint32_t gateEdges = edges - GateEdges;
+            uint32_t gateTime = now - GateTime;
+            if (gateTime != 0) {
+                Frequency.Value = fixed3_t::FromRaw(FixedSaturate((int64_t)gateEdges * 1000000 * 1000 / gateTime));
+                if (gateEdges != 0) {
+                    Period.Value = fixed3_t::FromRaw(FixedSaturate((int64_t)gateTime * 1000 / gateEdges));
+                } else {
+                    Period.Value.Clear();
+                }
+                Updated = context.Now;
+                if (Env::SensorsSendValues) {
+                    context.Send(this, Owner, new TEventSensorData(*this, Frequency));
+                    context.Send(this, Owner, new TEventSensorData(*this, Period));
+                }
+            }
+            GateEdges = edges;
+            GateTime = now;
+            LastReport = context.Now;
+        }
+        event->NotBefore = context.Now + PollPeriod;
+        context.Resend(this, event.Release());
+    }
+};
+
+}
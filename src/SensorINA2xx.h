@@ -1,12 +1,22 @@
 #pragma once
 
 #include "aw.h"
+#include "aw-files.h"
+#include "aw-interrupt.h"
 
 namespace AW {
 
-template <typename Env = TDefaultEnvironment>
+// INA219 / INA226 current and voltage sensor
+// INA226 with AlertPin connected to ALERT runs in continuous mode: the chip signals every conversion with the pin,
+// the actor reads it on TEventSignal and reports the average of all conversions every SensorsPeriod
+// (it holds a StandbyLock then, the EIC and micros() stop in the standby),
+// without AlertPin it is triggered once per SensorsPeriod and powered down between the shots
+// with Integrator set (continuous mode only) charge and energy are integrated at the conversion rate
+// by trapezoids over the ALERT timestamps, the totals and the peak current are reported and persisted every SavePeriod
+template <typename Env = TDefaultEnvironment, uint8_t AlertPin = 0>
 class TSensorINA2xx : public TActor, public TSensorSource {
     constexpr static bool UseChipCalculations = false;
+    constexpr static bool Continuous = AlertPin != 0;
 
     struct ERegisters {
         static constexpr uint8_t INA2xx_REG_CONFIG = 0x00;
@@ -15,6 +25,7 @@ class TSensorINA2xx : public TActor, public TSensorSource {
         static constexpr uint8_t INA2xx_REG_POWER = 0x03;
         static constexpr uint8_t INA2xx_REG_CURRENT = 0x04;
         static constexpr uint8_t INA2xx_REG_CALIBRATION = 0x05;
+        static constexpr uint8_t INA226_REG_MASK_ENABLE = 0x06;
         static constexpr uint8_t INA2xx_REG_MANUFACTURER_ID = 0xFE;
         static constexpr uint8_t INA2xx_REG_DIE_ID = 0xFF;
     };
@@ -106,6 +117,9 @@ class TSensorINA2xx : public TActor, public TSensorSource {
         INA226_CONFIG_MODE_SVOLT_CONTINUOUS = 0x0005,
         INA226_CONFIG_MODE_BVOLT_CONTINUOUS = 0x0006,
         INA226_CONFIG_MODE_SANDBVOLT_CONTINUOUS = 0x0007,
+
+        INA226_MASK_CNVR = 0x0400, // Conversion Ready on ALERT pin
+        INA226_MASK_CVRF = 0x0008, // Conversion Ready Flag, cleared by reading the register
     };
 
     struct TConfigRegister219 {
@@ -134,13 +148,63 @@ class TSensorINA2xx : public TActor, public TSensorSource {
 
     static constexpr TTime GetShotPeriod() { return TTime::MilliSeconds(69); /* 69ms */ }
 
+    static constexpr float RSHUNT226 = 0.02; // ohms
+    static constexpr float SHUNT_LSB226 = 0.0025; // mV
+    static constexpr float VOLTAGE_LSB226 = 0.00125; // V
+    // integrator units are 2 * LSB * us (the trapezoid sum isn't halved), 125 uA is SHUNT_LSB226 / RSHUNT226
+    static constexpr int64_t CHARGE_UNITS_PER_UAH226 = 2LL * 3600 * 1000000 / 125;
+    // 0.15625 uW is 125 uA * VOLTAGE_LSB226
+    static constexpr int64_t ENERGY_UNITS_PER_UWH226 = 2LL * 3600 * 1000000 * 100000 / 15625;
+    static constexpr int32_t CURRENT_LSB226 = 125; // uA
+
+    static uint16_t GetAveragingFlags226(uint16_t averaging) {
+        return averaging >= 1024 ? EFlags::INA226_CONFIG_AVG_1024
+            : averaging >= 512 ? EFlags::INA226_CONFIG_AVG_512
+            : averaging >= 256 ? EFlags::INA226_CONFIG_AVG_256
+            : averaging >= 128 ? EFlags::INA226_CONFIG_AVG_128
+            : averaging >= 64 ? EFlags::INA226_CONFIG_AVG_64
+            : averaging >= 16 ? EFlags::INA226_CONFIG_AVG_16
+            : averaging >= 4 ? EFlags::INA226_CONFIG_AVG_4
+            : EFlags::INA226_CONFIG_AVG_1;
+    }
+
+    // continuous mode accumulators, filled on every conversion
+    int32_t ShuntSum = 0;
+    uint32_t BusSum = 0;
+    uint16_t SampleCount = 0;
+
+    // integrator state, AlertTime is captured in the interrupt
+    volatile uint32_t AlertTime = 0;
+    bool HasLastSample = false;
+    uint32_t LastSampleTime = 0;
+    int16_t LastShunt = 0;
+    uint16_t LastBus = 0;
+    int16_t PeakShunt = 0;
+    int64_t ChargeUnits = 0;
+    int64_t EnergyUnits = 0;
+    // the totals are 64-bit, 32-bit uWh overflow after ~13 hours at 168 W
+    int64_t MicroAmpHours = 0;
+    int64_t MicroWattHours = 0;
+    // reported and persisted as mAh / mWh, the raw values of Charge / Energy
+    int32_t SavedMilliAmpHours = 0;
+    int32_t SavedMilliWattHours = 0;
+    TTime LastSave;
+
 public:
     uint8_t Address;
     uint16_t ChipId = 0;
     uint16_t ConfigValue;
+    // INA226 on-chip averaging of every conversion, 1..1024
+    uint16_t Averaging = 1;
     TActor* Owner;
     TAveragedSensorValue<fixed3_t, 60000 / Env::SensorsPeriod.MilliSeconds()> Voltage;
     TAveragedSensorValue<fixed3_t, 60000 / Env::SensorsPeriod.MilliSeconds()> Current;
+    bool Integrator = false;
+    IFileSystem* FileSystem = nullptr;
+    TTime SavePeriod = TTime::Minutes(10);
+    TSensorValueFixed3 Charge; // Ah
+    TSensorValueFixed3 Energy; // Wh
+    TSensorValueFixed3 Peak; // mA
 
     TSensorINA2xx(uint8_t address, TActor* owner, String name = "INA2xx")
         : Address(address)
@@ -149,6 +213,9 @@ public:
         Name = name;
         Voltage.Name = "voltage";
         Current.Name = "current";
+        Charge.Name = "charge";
+        Energy.Name = "energy";
+        Peak.Name = "peak";
     }
 
     static StringBuf GetSensorType(uint8_t address) {
@@ -182,6 +249,9 @@ protected:
                 case 0x2260:
                     return OnReceive226(static_cast<TEventReceive*>(event.Release()), context);
             }
+            break;
+        case TEventSignal::EventID:
+            return OnSignal226(static_cast<TEventSignal*>(event.Release()), context);
         default:
             break;
         }
@@ -210,12 +280,21 @@ protected:
                 EFlags::INA219_CONFIG_MODE_SANDBVOLT_CONTINUOUS;
                 break;
             case 0x2260:
-                ConfigValue =
-                EFlags::INA226_CONFIG_D14 |
-                EFlags::INA226_CONFIG_AVG_1 |
-                EFlags::INA226_CONFIG_VBUSCT_204US |
-                EFlags::INA226_CONFIG_VSHCT_204US |
-                EFlags::INA226_CONFIG_MODE_SANDBVOLT_TRIGGERED;
+                if (Continuous) {
+                    ConfigValue =
+                    EFlags::INA226_CONFIG_D14 |
+                    GetAveragingFlags226(Averaging) |
+                    EFlags::INA226_CONFIG_VBUSCT_1100US |
+                    EFlags::INA226_CONFIG_VSHCT_1100US |
+                    EFlags::INA226_CONFIG_MODE_SANDBVOLT_CONTINUOUS;
+                } else {
+                    ConfigValue =
+                    EFlags::INA226_CONFIG_D14 |
+                    GetAveragingFlags226(Averaging) |
+                    EFlags::INA226_CONFIG_VBUSCT_204US |
+                    EFlags::INA226_CONFIG_VSHCT_204US |
+                    EFlags::INA226_CONFIG_MODE_SANDBVOLT_TRIGGERED;
+                }
                 break;
         }
 
@@ -224,7 +303,27 @@ protected:
                 static constexpr uint16_t CalibrationValue = 32768;
                 Env::Wire::WriteValue(Address, ERegisters::INA2xx_REG_CALIBRATION, CalibrationValue);
             }
-            context.Send(this, this, new AW::TEventReceive());
+            if (Continuous && ChipId == 0x2260) {
+                if (Integrator && FileSystem != nullptr) {
+                    SavedMilliAmpHours = FileSystem->ReadValue<long>(Name + StringBuf(".charge"));
+                    SavedMilliWattHours = FileSystem->ReadValue<long>(Name + StringBuf(".energy"));
+                    MicroAmpHours = (int64_t)SavedMilliAmpHours * 1000;
+                    MicroWattHours = (int64_t)SavedMilliWattHours * 1000;
+                }
+                LastSave = context.Now;
+                uint16_t maskValue = EFlags::INA226_MASK_CNVR;
+                Env::Wire::WriteValue(Address, ERegisters::INA226_REG_MASK_ENABLE, maskValue);
+                pinMode(AlertPin, INPUT_PULLUP);
+                // the conversions go on in the sleep, the edges and micros() of the trapezoids too
+                if (TPinInterrupts::Attach(AlertPin, FALLING, StaticAlert, this, true)) {
+                    ++context.ActorLib.StandbyLocks;
+                } else if (Env::Diagnostics) {
+                    context.Send(this, Owner, new AW::TEventSensorMessage(*this, StringStream() << "No free interrupt slot"));
+                }
+                context.Send(this, this, new AW::TEventReceive(context.Now + Env::SensorsPeriod));
+            } else {
+                context.Send(this, this, new AW::TEventReceive());
+            }
             if (Env::Diagnostics) {
                 switch (ChipId) {
                 case 0x2190:
@@ -387,7 +486,110 @@ protected:
         }
     }
 
+    // reads one conversion in continuous mode, the flag read also releases ALERT
+    bool ReadSample226() {
+        uint16_t mask_value = 0;
+        if (!Env::Wire::ReadValue(Address, ERegisters::INA226_REG_MASK_ENABLE, mask_value) || (mask_value & EFlags::INA226_MASK_CVRF) == 0) {
+            return false;
+        }
+        int16_t shunt_voltage = 0;
+        uint16_t bus_voltage = 0;
+        Env::Wire::ReadValue(Address, ERegisters::INA2xx_REG_SHUNTVOLTAGE, shunt_voltage);
+        Env::Wire::ReadValue(Address, ERegisters::INA2xx_REG_BUSVOLTAGE, bus_voltage);
+        if (SampleCount != 0xffff) {
+            ShuntSum += shunt_voltage;
+            BusSum += bus_voltage;
+            ++SampleCount;
+        }
+        if (Integrator) {
+            Integrate(AlertTime, shunt_voltage, bus_voltage);
+        }
+        return true;
+    }
+
+    void Integrate(uint32_t time, int16_t shunt, uint16_t bus) {
+        if (HasLastSample) {
+            int64_t duration = (uint32_t)(time - LastSampleTime);
+            ChargeUnits += ((int32_t)LastShunt + shunt) * duration;
+            EnergyUnits += ((int64_t)LastShunt * LastBus + (int64_t)shunt * bus) * duration;
+        }
+        HasLastSample = true;
+        LastSampleTime = time;
+        LastShunt = shunt;
+        LastBus = bus;
+        int16_t absolute = shunt < 0 ? -shunt : shunt;
+        if (absolute > PeakShunt) {
+            PeakShunt = absolute;
+        }
+    }
+
+    // moves whole units from the integrator to the total
+    static int64_t TakeWhole(int64_t& units, int64_t unitsPerWhole) {
+        int64_t whole = units / unitsPerWhole;
+        units -= whole * unitsPerWhole;
+        return whole;
+    }
+
+    void ReportIntegrator(const AW::TActorContext& context) {
+        MicroAmpHours += TakeWhole(ChargeUnits, CHARGE_UNITS_PER_UAH226);
+        MicroWattHours += TakeWhole(EnergyUnits, ENERGY_UNITS_PER_UWH226);
+        int32_t milliAmpHours = FixedSaturate(MicroAmpHours / 1000);
+        int32_t milliWattHours = FixedSaturate(MicroWattHours / 1000);
+        Charge.Value = fixed3_t::FromRaw(milliAmpHours);
+        Energy.Value = fixed3_t::FromRaw(milliWattHours);
+        Peak.Value = fixed3_t::FromRaw((int32_t)PeakShunt * CURRENT_LSB226);
+        PeakShunt = 0;
+        if (Env::SensorsSendValues) {
+            context.Send(this, Owner, new AW::TEventSensorData(*this, Charge));
+            context.Send(this, Owner, new AW::TEventSensorData(*this, Energy));
+            context.Send(this, Owner, new AW::TEventSensorData(*this, Peak));
+        }
+        if (FileSystem != nullptr && context.Now - LastSave >= SavePeriod
+                && (milliAmpHours != SavedMilliAmpHours || milliWattHours != SavedMilliWattHours)) {
+            if (FileSystem->WriteValue(Name + StringBuf(".charge"), (long)milliAmpHours) && FileSystem->WriteValue(Name + StringBuf(".energy"), (long)milliWattHours)) {
+                SavedMilliAmpHours = milliAmpHours;
+                SavedMilliWattHours = milliWattHours;
+            }
+            LastSave = context.Now;
+        }
+    }
+
+    void OnSignal226(AW::TUniquePtr<AW::TEventSignal>, const AW::TActorContext&) {
+        if (Continuous && ChipId == 0x2260) {
+            ReadSample226();
+        }
+    }
+
     void OnReceive226(AW::TUniquePtr<AW::TEventReceive> event, const AW::TActorContext& context) {
+        if (Continuous) {
+            event->NotBefore = context.Now + Env::SensorsPeriod;
+            context.Resend(this, event.Release());
+            if (digitalRead(AlertPin) == LOW) {
+                // the edge was missed, ALERT stays low until the flag is read
+                ReadSample226();
+            }
+            if (Env::Diagnostics) {
+                context.Send(this, Owner, new AW::TEventSensorMessage(*this, StringStream() << "samples " << SampleCount));
+            }
+            if (SampleCount != 0) {
+                SetValues226(float(BusSum) / SampleCount * VOLTAGE_LSB226, float(ShuntSum) / SampleCount * SHUNT_LSB226);
+            } else {
+                Voltage.Clear();
+                Current.Clear();
+            }
+            ShuntSum = 0;
+            BusSum = 0;
+            SampleCount = 0;
+            Updated = context.Now;
+            if (Env::SensorsSendValues) {
+                context.Send(this, Owner, new AW::TEventSensorData(*this, Voltage));
+                context.Send(this, Owner, new AW::TEventSensorData(*this, Current));
+            }
+            if (Integrator) {
+                ReportIntegrator(context);
+            }
+            return;
+        }
         if (Stage == EStage::Shot) {
             Stage = EStage::Data;
             event->NotBefore = context.Now + GetShotPeriod();
@@ -406,15 +608,11 @@ protected:
         int16_t shunt_voltage = 0;
         uint16_t bus_voltage = 0;
 
-        static constexpr float RSHUNT = 0.02; // ohms
-        static constexpr float shuntLSB = 0.0025; // mV
-        static constexpr float voltageLSB = 0.00125; // V
-
         Env::Wire::ReadValue(Address, ERegisters::INA2xx_REG_SHUNTVOLTAGE, shunt_voltage);
         Env::Wire::ReadValue(Address, ERegisters::INA2xx_REG_BUSVOLTAGE, bus_voltage);
 
-        float busValue = float(bus_voltage) * voltageLSB;
-        float shuntValue = float(shunt_voltage) * shuntLSB;
+        float busValue = float(bus_voltage) * VOLTAGE_LSB226;
+        float shuntValue = float(shunt_voltage) * SHUNT_LSB226;
 
         if (Env::Diagnostics) {
             context.Send(this, Owner, new AW::TEventSensorMessage(*this, StringStream() << "bus " << String(bus_voltage, 16) << " (" << busValue << ")"));
@@ -425,16 +623,7 @@ protected:
             Voltage.Clear();
             Current.Clear();
         } else {
-            if (busValue) {
-                Voltage = busValue;
-            } else {
-                Voltage.Clear();
-            }
-
-            float currentValue;
-
-            currentValue = shuntValue / RSHUNT;
-            Current = currentValue;
+            SetValues226(busValue, shuntValue);
         }
 
         uint16_t configValue = EFlags::INA226_CONFIG_MODE_POWERDOWN;
@@ -451,6 +640,21 @@ protected:
             context.Send(this, Owner, new AW::TEventSensorMessage(*this, StringStream() << "receive elapsed " << (micros() - start) << "us"));
         }
     }
+
+    void SetValues226(float busValue, float shuntValue) {
+        if (busValue) {
+            Voltage = busValue;
+        } else {
+            Voltage.Clear();
+        }
+        Current = shuntValue / RSHUNT226;
+    }
+
+    static void StaticAlert(void* context) {
+        TSensorINA2xx* sensor = static_cast<TSensorINA2xx*>(context);
+        sensor->AlertTime = micros();
+        sensor->Signal();
+    }
 };
 
 }
\ No newline at end of file
@@ -1,16 +1,18 @@
 #pragma once
 
 #include "aw.h"
+#include "aw-serial.h"
 
 namespace AW {
 
+// the sensor is polled through TSerialTransactionActor, the response comes as TEventSerialResponse
 template <typename SerialType, typename Env = TDefaultEnvironment>
 class TSensorMHZ19 : public TActor, public TSensorSource {
 public:
     uint8_t Address;
     uint16_t ChipId = 0;
     uint16_t ConfigValue;
-    SerialType Serial;
+    TSerialTransactionActor<SerialType, TComplementChecksum> Serial;
     TActor* Owner;
     TSensorValueFloat CO2;
     TSensorValueFloat Temperature;
@@ -34,24 +36,34 @@ protected:
             return OnBootstrap(static_cast<TEventBootstrap*>(event.Release()), context);
         case TEventReceive::EventID:
             return OnReceive(static_cast<TEventReceive*>(event.Release()), context);
+        case TEventSerialResponse::EventID:
+            return OnResponse(static_cast<TEventSerialResponse*>(event.Release()), context);
         default:
             break;
         }
     }
 
-    void Dump(const char (&data)[9], const TActorContext& context) {
+    static constexpr uint8_t PacketSize = 9;
+
+    void Dump(const String& data, const TActorContext& context) {
         StringStream stream;
-        for (size_t i = 0; i < 9; ++i) {
+        for (String::size_type i = 0; i < data.size(); ++i) {
             if (i != 0) {
                 stream << ':';
             }
-            stream << String(int(data[i]), 16);
+            stream << String(int((uint8_t)data[i]), 16);
         }
         context.Send(this, Owner, new AW::TEventSensorMessage(*this, stream));
     }
 
+    void Command(uint8_t command, uint8_t responseSize, const TActorContext& context) {
+        char request[PacketSize] = {(char)0xFF, 0x01, (char)command, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00};
+        request[PacketSize - 1] = (char)TComplementChecksum::Get(request, PacketSize);
+        context.Send(this, &Serial, new TEventSerialRequest(String(request, PacketSize), responseSize));
+    }
+
     void OnBootstrap(TUniquePtr<TEventBootstrap>, const TActorContext& context) {
-        Serial.Begin();
+        context.ActorLib.Register(&Serial);
         context.Send(this, this, new AW::TEventReceive());
         Calibrations = 0;
     }
@@ -59,19 +71,15 @@ protected:
     void OnReceive(AW::TUniquePtr<AW::TEventReceive> event, const AW::TActorContext& context) {
         event->NotBefore = context.Now + Env::SensorsPeriod;
         context.Resend(this, event.Release());
+        Command(0x86, PacketSize, context); // read CO2
+    }
 
-        char request[9] = {0xFF, 0x01, 0x86, 0x00, 0x00, 0x00, 0x00, 0x00, 0x79};
-        char response[9] = {};
-
-        while (Serial.AvailableForRead()) {
-            Serial.Read(response, 1);
-        }
-        Serial.Write(request, 9);
-        // TODO: sleep?
-        int sz = Serial.Read(response, 9);
-        if (sz == 9 && (response[6]*256 + response[7]) != 15000 && response[4] != 0) {
-            CO2 = float((uint16_t(response[2]) << 8) + response[3]);
-            Temperature = float(int16_t(response[4]) - 40);
+    void OnResponse(AW::TUniquePtr<AW::TEventSerialResponse> event, const AW::TActorContext& context) {
+        const String& response(event->Data);
+        auto byte = [&response](String::size_type i) -> uint8_t { return (uint8_t)response[i]; };
+        if (event->Status == ESerialStatus::Ok && byte(1) == 0x86 && (byte(6) * 256 + byte(7)) != 15000 && byte(4) != 0) {
+            CO2 = float((uint16_t(byte(2)) << 8) + byte(3));
+            Temperature = float(int16_t(byte(4)) - 40);
 
             if (Env::SensorsSendValues) {
                 context.Send(this, Owner, new AW::TEventSensorData(*this, CO2));
@@ -83,8 +91,7 @@ protected:
             }
 
             if (context.Now - LastCO2Seen > TTime::Minutes(20)) {
-                char request[9] = {0xFF, 0x01, 0x87, 0x00, 0x00, 0x00, 0x00, 0x00, 0x78}; // zero point calibration
-                Serial.Write(request, 9);
+                Command(0x87, 0, context); // zero point calibration
                 Calibrations.SetValue(Calibrations.Value.GetValue() + 1);
                 LastCO2Seen = context.Now;
                 if (Env::SensorsSendValues) {
@@ -102,13 +109,12 @@ protected:
                 if (Env::Diagnostics) {
                     context.Send(this, Owner, new AW::TEventSensorMessage(*this, StringStream() << "disable ABC"));
                 }
-                char request[9] = {0xFF, 0x01, 0x79, 0x00, 0x00, 0x00, 0x00, 0x00, 0x86}; // disable ABC
-                Serial.Write(request, 9);
+                Command(0x79, 0, context); // disable ABC
                 Good = true;
             }
         } else {
             if (Env::Diagnostics) {
-                context.Send(this, Owner, new AW::TEventSensorMessage(*this, StringStream() << "received BAD response (" << sz << " bytes)"));
+                context.Send(this, Owner, new AW::TEventSensorMessage(*this, StringStream() << "received BAD response (" << response.size() << " bytes, status " << int(event->Status) << ")"));
             }
             Good = false;
         }
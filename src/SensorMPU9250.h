@@ -1,34 +1,97 @@
 #pragma once
 
-#include "ArduinoWorkflow.h"
-#include <MPU9250.h>
-#include <quaternionFilters.h>
+#include "aw.h"
+#include "aw-mahony.h"
+#include "aw-rms.h"
 
 namespace AW {
 
-template <typename Env = TDefaultEnvironment>
+// MPU-9250 (MPU-6500 + AK8963) with the accelerometer and the gyroscope sampled by the chip into its FIFO at SampleRate,
+// the FIFO is burst-drained every time it gets half full, every sample goes through the fixed-point Mahony filter,
+// the gyroscope bias is taken from the first second of samples, so the sensor should stay still at power-on
+// every SensorsPeriod the actor reports:
+//   accelerometer (mg) and gyroscope (dps) averaged over the period,
+//   magnetometer (mG, the last reading, in the AK8963 axes, only factory sensitivity adjustment and MagnetometerBias applied),
+//   roll / pitch / yaw (degrees) of the filter, the yaw is gyroscope-only and drifts,
+//   peak and RMS deviation of the acceleration magnitude (g), peak rotation rate (dps) and the temperature
+template <typename Env = TDefaultEnvironment, uint16_t SampleRate = 200>
 class TSensorMPU9250 : public TActor, public TSensorSource {
+    static_assert(SampleRate >= 4 && SampleRate <= 1000, "the sample rate is 1 kHz / (1 + SMPLRT_DIV)");
+    static_assert(1000 % SampleRate == 0, "the sample rate must divide 1 kHz, the filter and the gyroscope scale assume the exact rate");
+
+    struct ERegisters {
+        static constexpr uint8_t MPU9250_SMPLRT_DIV = 0x19;
+        static constexpr uint8_t MPU9250_CONFIG = 0x1A;
+        static constexpr uint8_t MPU9250_GYRO_CONFIG = 0x1B;
+        static constexpr uint8_t MPU9250_ACCEL_CONFIG = 0x1C;
+        static constexpr uint8_t MPU9250_ACCEL_CONFIG2 = 0x1D;
+        static constexpr uint8_t MPU9250_FIFO_EN = 0x23;
+        static constexpr uint8_t MPU9250_INT_PIN_CFG = 0x37;
+        static constexpr uint8_t MPU9250_INT_ENABLE = 0x38;
+        static constexpr uint8_t MPU9250_INT_STATUS = 0x3A;
+        static constexpr uint8_t MPU9250_TEMP_OUT_H = 0x41;
+        static constexpr uint8_t MPU9250_USER_CTRL = 0x6A;
+        static constexpr uint8_t MPU9250_PWR_MGMT_1 = 0x6B;
+        static constexpr uint8_t MPU9250_FIFO_COUNTH = 0x72;
+        static constexpr uint8_t MPU9250_FIFO_R_W = 0x74;
+        static constexpr uint8_t MPU9250_WHO_AM_I = 0x75;
+
+        static constexpr uint8_t AK8963_WIA = 0x00;
+        static constexpr uint8_t AK8963_ST1 = 0x02;
+        static constexpr uint8_t AK8963_HXL = 0x03;
+        static constexpr uint8_t AK8963_CNTL1 = 0x0A;
+        static constexpr uint8_t AK8963_ASAX = 0x10;
+    };
+
+    enum EFlags : uint8_t {
+        MPU9250_PWR_MGMT_1_RESET = 0x80,
+        MPU9250_PWR_MGMT_1_CLKSEL_PLL = 0x01,
+        MPU9250_CONFIG_DLPF_41HZ = 0x03,
+        MPU9250_GYRO_CONFIG_2000DPS = 0x18,
+        MPU9250_ACCEL_CONFIG_4G = 0x08,
+        MPU9250_ACCEL_CONFIG2_DLPF_41HZ = 0x03,
+        MPU9250_FIFO_EN_GYRO = 0x70,
+        MPU9250_FIFO_EN_ACCEL = 0x08,
+        MPU9250_INT_PIN_CFG_BYPASS_EN = 0x02,
+        MPU9250_INT_FIFO_OFLOW = 0x10,
+        MPU9250_USER_CTRL_FIFO_EN = 0x40,
+        MPU9250_USER_CTRL_FIFO_RST = 0x04,
+
+        AK8963_ST1_DRDY = 0x01,
+        AK8963_ST2_HOFL = 0x08,
+        AK8963_CNTL1_POWERDOWN = 0x00,
+        AK8963_CNTL1_FUSE_ROM = 0x0F,
+        AK8963_CNTL1_16BIT_100HZ = 0x16,
+    };
+
 public:
     uint8_t AddressMPU6500 = 0x68;
     uint8_t AddressAK8963 = 0x0c;
     TActor* Owner;
+    int16_t MagnetometerBias[3] = {}; // mG
 
     struct TSensor3DValues {
-        TSensorValue X;
-        TSensorValue Y;
-        TSensorValue Z;
+        TSensorValueFixed3 X;
+        TSensorValueFixed3 Y;
+        TSensorValueFixed3 Z;
     };
 
     TSensor3DValues Accelerometer;
     TSensor3DValues Gyroscope;
     TSensor3DValues Magnetometer;
-    TSensorValue Temperature;
+    TSensorValueFixed3 Roll;
+    TSensorValueFixed3 Pitch;
+    TSensorValueFixed3 Yaw;
+    TSensorValueFixed3 AccelerationPeak;
+    TSensorValueFixed3 Vibration;
+    TSensorValueFixed3 RotationPeak;
+    TSensorValueFixed3 Temperature;
 
     TSensorMPU9250(uint8_t addressMPU6500, uint8_t addressAK9063, TActor* owner, StringBuf name = "mpu9250")
         : AddressMPU6500(addressMPU6500)
         , AddressAK8963(addressAK9063)
         , Owner(owner)
-        , IMU(addressMPU6500, Wire, 400000) {
+        , Filter(1.0f, 0.0f, SampleRate) {
         Name = name;
         Accelerometer.X.Name = "accelerometer.X";
         Accelerometer.Y.Name = "accelerometer.Y";
@@ -39,11 +102,55 @@ public:
         Magnetometer.X.Name = "magnetometer.X";
         Magnetometer.Y.Name = "magnetometer.Y";
         Magnetometer.Z.Name = "magnetometer.Z";
+        Roll.Name = "roll";
+        Pitch.Name = "pitch";
+        Yaw.Name = "yaw";
+        AccelerationPeak.Name = "acceleration.peak";
+        Vibration.Name = "vibration";
+        RotationPeak.Name = "rotation.peak";
         Temperature.Name = "temperature";
     }
 
 protected:
-    MPU9250 IMU;
+    // accelerometer and gyroscope, big-endian X / Y / Z each
+    static constexpr uint8_t FrameSize = 12;
+    static constexpr uint16_t FIFOSize = 512;
+    // two frames per burst fit into the smallest (32 bytes, AVR) Wire buffer
+    static constexpr uint8_t FramesPerRead = 2;
+    // +-4 g
+    static constexpr int32_t AccelerometerLSBPerG = 8192;
+    // +-2000 dps, 16.4 LSB per dps
+    static constexpr int32_t GyroscopeLSBPerDPS10 = 164;
+    // Q8 gyroscope units to radians per sample in Q30, with 8 more bits of precision
+    static constexpr int64_t GyroscopeToAngle = (int64_t)(DEG_TO_RAD * 10 / GyroscopeLSBPerDPS10 / SampleRate * (1LL << 38) + 0.5);
+
+    // half of the FIFO
+    static TTime GetDrainPeriod() {
+        return TTime::MilliSeconds((uint32_t)FIFOSize / FrameSize / 2 * 1000 / SampleRate);
+    }
+
+    struct TFrame {
+        uint8_t Data[FrameSize];
+    };
+
+    struct TStatistics {
+        int64_t Acceleration[3];
+        int64_t Rotation[3]; // Q8
+        int32_t Magnitude;
+        uint64_t MagnitudeSquares;
+        uint32_t MagnitudePeak;
+        uint64_t RotationPeakSquares; // Q16
+        uint32_t Count;
+    };
+
+    TMahonyFilter Filter;
+    bool HasMagnetometer = false;
+    uint16_t MagnetometerAdjustment[3] = {};
+    int32_t GyroscopeBias[3] = {}; // Q8
+    uint16_t BiasCount = 0;
+    TStatistics Statistics = {};
+    uint16_t Overflows = 0;
+    TTime LastReport;
 
     void OnEvent(TEventPtr event, const TActorContext& context) override {
         switch (event->EventID) {
@@ -56,37 +163,72 @@ protected:
         }
     }
 
+    static int16_t GetInt16(const uint8_t* data) {
+        return (int16_t)(((uint16_t)data[0] << 8) | data[1]);
+    }
+
+    bool Write(uint8_t reg, uint8_t value) {
+        return Env::Wire::WriteValue(AddressMPU6500, reg, value);
+    }
+
+    void ResetFIFO() {
+        Write(ERegisters::MPU9250_USER_CTRL, MPU9250_USER_CTRL_FIFO_EN | MPU9250_USER_CTRL_FIFO_RST);
+    }
+
+    void InitMPU6500() {
+        Write(ERegisters::MPU9250_PWR_MGMT_1, MPU9250_PWR_MGMT_1_RESET);
+        delay(100);
+        Write(ERegisters::MPU9250_PWR_MGMT_1, MPU9250_PWR_MGMT_1_CLKSEL_PLL);
+        delay(100);
+        Write(ERegisters::MPU9250_CONFIG, MPU9250_CONFIG_DLPF_41HZ);
+        Write(ERegisters::MPU9250_SMPLRT_DIV, (uint8_t)(1000 / SampleRate - 1));
+        Write(ERegisters::MPU9250_GYRO_CONFIG, MPU9250_GYRO_CONFIG_2000DPS);
+        Write(ERegisters::MPU9250_ACCEL_CONFIG, MPU9250_ACCEL_CONFIG_4G);
+        Write(ERegisters::MPU9250_ACCEL_CONFIG2, MPU9250_ACCEL_CONFIG2_DLPF_41HZ);
+        // the AK8963 is accessed directly on the same bus
+        Write(ERegisters::MPU9250_INT_PIN_CFG, MPU9250_INT_PIN_CFG_BYPASS_EN);
+        Write(ERegisters::MPU9250_INT_ENABLE, MPU9250_INT_FIFO_OFLOW);
+        Write(ERegisters::MPU9250_FIFO_EN, MPU9250_FIFO_EN_ACCEL | MPU9250_FIFO_EN_GYRO);
+        ResetFIFO();
+    }
+
+    bool InitAK8963() {
+        uint8_t chipId;
+        if (!Env::Wire::ReadValue(AddressAK8963, ERegisters::AK8963_WIA, chipId) || chipId != 0x48) {
+            return false;
+        }
+        uint8_t asa[3];
+        Env::Wire::WriteValue(AddressAK8963, ERegisters::AK8963_CNTL1, (uint8_t)AK8963_CNTL1_POWERDOWN);
+        delay(10);
+        Env::Wire::WriteValue(AddressAK8963, ERegisters::AK8963_CNTL1, (uint8_t)AK8963_CNTL1_FUSE_ROM);
+        delay(10);
+        if (!Env::Wire::ReadValue(AddressAK8963, ERegisters::AK8963_ASAX, asa)) {
+            return false;
+        }
+        for (uint8_t i = 0; i < 3; ++i) {
+            // sensitivity adjustment is (ASA + 128) / 256
+            MagnetometerAdjustment[i] = asa[i] + 128;
+        }
+        Env::Wire::WriteValue(AddressAK8963, ERegisters::AK8963_CNTL1, (uint8_t)AK8963_CNTL1_POWERDOWN);
+        delay(10);
+        return Env::Wire::WriteValue(AddressAK8963, ERegisters::AK8963_CNTL1, (uint8_t)AK8963_CNTL1_16BIT_100HZ);
+    }
+
     void OnBootstrap(TUniquePtr<TEventBootstrap>, const TActorContext& context) {
-        uint8_t chipId1 = IMU.readByte(AddressMPU6500, WHO_AM_I_MPU9250);
-        if (chipId1 == 0x71) {
+        uint8_t chipId;
+        if (Env::Wire::ReadValue(AddressMPU6500, ERegisters::MPU9250_WHO_AM_I, chipId) && (chipId == 0x71 || chipId == 0x73)) {
+            InitMPU6500();
+            HasMagnetometer = InitAK8963();
             if (Env::Diagnostics) {
-                context.Send(this, Owner, new AW::TEventSensorMessage(*this, StringStream() << "MPU6500 on " << String(AddressMPU6500, 16)));
-            }
-            IMU.MPU9250SelfTest(IMU.selfTest);
-            IMU.calibrateMPU9250(IMU.gyroBias, IMU.accelBias);
-            IMU.initMPU9250();
-            uint8_t chipId2 = IMU.readByte(AddressAK8963, WHO_AM_I_AK8963);
-            if (chipId2 == 0x48) {
-                if (Env::Diagnostics) {
+                context.Send(this, Owner, new AW::TEventSensorMessage(*this, StringStream() << "MPU6500 on " << String(AddressMPU6500, 16) << " at " << SampleRate << "Hz"));
+                if (HasMagnetometer) {
                     context.Send(this, Owner, new AW::TEventSensorMessage(*this, StringStream() << "AK8963 on " << String(AddressAK8963, 16)));
-                }
-                IMU.initAK8963(IMU.factoryMagCalibration);
-                IMU.getAres();
-                IMU.getGres();
-                IMU.getMres();
-                //IMU.magCalMPU9250(IMU.magBias, IMU.magScale);
-                IMU.magBias[0] = -987.25;
-                IMU.magBias[1] = 1498.18;
-                IMU.magBias[2] = 828.88;
-                IMU.magScale[0] = 1.18;
-                IMU.magScale[1] = 0.66;
-                IMU.magScale[1] = 1.55;
-                context.Send(this, this, new AW::TEventReceive());
-            } else {
-                if (Env::Diagnostics) {
+                } else {
                     context.Send(this, Owner, new AW::TEventSensorMessage(*this, StringStream() << "Failed to initialize AK8963"));
                 }
             }
+            LastReport = context.Now;
+            context.Send(this, this, new AW::TEventReceive(context.Now + GetDrainPeriod()));
         } else {
             if (Env::Diagnostics) {
                 context.Send(this, Owner, new AW::TEventSensorMessage(*this, StringStream() << "Failed to initialize MPU9250"));
@@ -94,74 +236,167 @@ protected:
         }
     }
 
-    void OnReceive(AW::TUniquePtr<AW::TEventReceive> event, const AW::TActorContext& context) {
-        if (IMU.readByte(AddressMPU6500, INT_STATUS) & 0x01) {
-            IMU.readAccelData(IMU.accelCount); // Read the x/y/z adc values
-            // Now we'll calculate the accleration value into actual g's
-            // This depends on scale being set
-            IMU.ax = (float)IMU.accelCount[0] * IMU.aRes; // - IMU.accelBias[0];
-            IMU.ay = (float)IMU.accelCount[1] * IMU.aRes; // - IMU.accelBias[1];
-            IMU.az = (float)IMU.accelCount[2] * IMU.aRes; // - IMU.accelBias[2];
-
-            IMU.readGyroData(IMU.gyroCount);  // Read the x/y/z adc values
-            // Calculate the gyro value into actual degrees per second
-            // This depends on scale being set
-            IMU.gx = (float)IMU.gyroCount[0] * IMU.gRes;
-            IMU.gy = (float)IMU.gyroCount[1] * IMU.gRes;
-            IMU.gz = (float)IMU.gyroCount[2] * IMU.gRes;
-
-            IMU.readMagData(IMU.magCount);  // Read the x/y/z adc values
-            // Calculate the magnetometer values in milliGauss
-            // Include factory calibration per data sheet and user environmental
-            // corrections
-            // Get actual magnetometer value, this depends on scale being set
-            IMU.mx = (float)IMU.magCount[0] * IMU.mRes * IMU.factoryMagCalibration[0] - IMU.magBias[0];
-            IMU.my = (float)IMU.magCount[1] * IMU.mRes * IMU.factoryMagCalibration[1] - IMU.magBias[1];
-            IMU.mz = (float)IMU.magCount[2] * IMU.mRes * IMU.factoryMagCalibration[2] - IMU.magBias[2];
-
-            IMU.updateTime();
-
-            // Sensors x (y)-axis of the accelerometer is aligned with the y (x)-axis of
-            // the magnetometer; the magnetometer z-axis (+ down) is opposite to z-axis
-            // (+ up) of accelerometer and gyro! We have to make some allowance for this
-            // orientationmismatch in feeding the output to the quaternion filter. For the
-            // MPU-9250, we have chosen a magnetic rotation that keeps the sensor forward
-            // along the x-axis just like in the LSM9DS0 sensor. This rotation can be
-            // modified to allow any convenient orientation convention. This is ok by
-            // aircraft orientation standards! Pass gyro rate as rad/s
-            MahonyQuaternionUpdate(IMU.ax, IMU.ay, IMU.az, IMU.gx * DEG_TO_RAD, IMU.gy * DEG_TO_RAD, IMU.gz * DEG_TO_RAD, IMU.my, IMU.mx, IMU.mz, IMU.deltat);
-
-            Accelerometer.X = 1000 * IMU.ax;
-            Accelerometer.Y = 1000 * IMU.ay;
-            Accelerometer.Z = 1000 * IMU.az;
-            Gyroscope.X = IMU.gx;
-            Gyroscope.Y = IMU.gy;
-            Gyroscope.Z = IMU.gz;
-            Magnetometer.X = IMU.mx;
-            Magnetometer.Y = IMU.my;
-            Magnetometer.Z = IMU.mz;
-
-            IMU.tempCount = IMU.readTempData();
-            IMU.temperature = ((float)IMU.tempCount) / 333.87 + 21.0;
-            Temperature = IMU.temperature;
+    void OnFrame(const TFrame& frame) {
+        int32_t acceleration[3];
+        int32_t rotation[3];
+        for (uint8_t i = 0; i < 3; ++i) {
+            acceleration[i] = GetInt16(frame.Data + i * 2);
+            rotation[i] = (int32_t)GetInt16(frame.Data + 6 + i * 2) << 8;
+        }
+        if (BiasCount < SampleRate) {
+            // raw sums first, Q8 averages after the last one
+            for (uint8_t i = 0; i < 3; ++i) {
+                GyroscopeBias[i] += rotation[i] >> 8;
+            }
+            if (++BiasCount == SampleRate) {
+                for (uint8_t i = 0; i < 3; ++i) {
+                    GyroscopeBias[i] = (int32_t)((int64_t)GyroscopeBias[i] * 256 / SampleRate);
+                }
+            }
+            return;
+        }
+        for (uint8_t i = 0; i < 3; ++i) {
+            rotation[i] -= GyroscopeBias[i];
+        }
+        Filter.Update(
+            (int32_t)((rotation[0] * GyroscopeToAngle) >> 16),
+            (int32_t)((rotation[1] * GyroscopeToAngle) >> 16),
+            (int32_t)((rotation[2] * GyroscopeToAngle) >> 16),
+            acceleration[0], acceleration[1], acceleration[2]);
+        uint32_t magnitude = ISqrt((uint64_t)((int64_t)acceleration[0] * acceleration[0] + (int64_t)acceleration[1] * acceleration[1] + (int64_t)acceleration[2] * acceleration[2]));
+        uint64_t rotationSquares = (uint64_t)((int64_t)rotation[0] * rotation[0] + (int64_t)rotation[1] * rotation[1] + (int64_t)rotation[2] * rotation[2]);
+        for (uint8_t i = 0; i < 3; ++i) {
+            Statistics.Acceleration[i] += acceleration[i];
+            Statistics.Rotation[i] += rotation[i];
+        }
+        Statistics.Magnitude += magnitude;
+        Statistics.MagnitudeSquares += (uint64_t)magnitude * magnitude;
+        if (magnitude > Statistics.MagnitudePeak) {
+            Statistics.MagnitudePeak = magnitude;
+        }
+        if (rotationSquares > Statistics.RotationPeakSquares) {
+            Statistics.RotationPeakSquares = rotationSquares;
+        }
+        ++Statistics.Count;
+    }
 
-            Updated = context.Now;
+    // returns false on the FIFO overflow, the FIFO is restarted then
+    bool Drain() {
+        uint8_t status;
+        uint16_t count;
+        if (!Env::Wire::ReadValue(AddressMPU6500, ERegisters::MPU9250_INT_STATUS, status)
+            || !Env::Wire::ReadValue(AddressMPU6500, ERegisters::MPU9250_FIFO_COUNTH, count)) {
+            return true;
+        }
+        count &= 0x1fff;
+        if ((status & MPU9250_INT_FIFO_OFLOW) != 0 || count >= FIFOSize || count % FrameSize != 0) {
+            // the oldest samples are lost, the frames are misaligned
+            ResetFIFO();
+            return false;
+        }
+        uint16_t frames = count / FrameSize;
+        TFrame burst[FramesPerRead];
+        while (frames >= FramesPerRead) {
+            if (!Env::Wire::ReadValue(AddressMPU6500, ERegisters::MPU9250_FIFO_R_W, burst)) {
+                return true;
+            }
+            for (uint8_t i = 0; i < FramesPerRead; ++i) {
+                OnFrame(burst[i]);
+            }
+            frames -= FramesPerRead;
+        }
+        while (frames > 0) {
+            if (!Env::Wire::ReadValue(AddressMPU6500, ERegisters::MPU9250_FIFO_R_W, burst[0])) {
+                return true;
+            }
+            OnFrame(burst[0]);
+            --frames;
+        }
+        return true;
+    }
 
-            if (Env::SensorsSendValues) {
-                context.Send(this, Owner, new AW::TEventSensorData(*this, Accelerometer.X));
-                context.Send(this, Owner, new AW::TEventSensorData(*this, Accelerometer.Y));
-                context.Send(this, Owner, new AW::TEventSensorData(*this, Accelerometer.Z));
-                context.Send(this, Owner, new AW::TEventSensorData(*this, Gyroscope.X));
-                context.Send(this, Owner, new AW::TEventSensorData(*this, Gyroscope.Y));
-                context.Send(this, Owner, new AW::TEventSensorData(*this, Gyroscope.Z));
+    void ReadMagnetometer() {
+        uint8_t status;
+        // HXL..HZH and ST2, ST2 has to be read to release the data registers
+        uint8_t data[7];
+        if (!Env::Wire::ReadValue(AddressAK8963, ERegisters::AK8963_ST1, status) || (status & AK8963_ST1_DRDY) == 0) {
+            return;
+        }
+        if (!Env::Wire::ReadValue(AddressAK8963, ERegisters::AK8963_HXL, data) || (data[6] & AK8963_ST2_HOFL) != 0) {
+            return;
+        }
+        TSensorValueFixed3* values[3] = {&Magnetometer.X, &Magnetometer.Y, &Magnetometer.Z};
+        for (uint8_t i = 0; i < 3; ++i) {
+            int32_t raw = (int16_t)(((uint16_t)data[i * 2 + 1] << 8) | data[i * 2]);
+            // 1.5 mG per LSB in 16-bit mode
+            // raw * adjustment * 1500 doesn't fit int32 above 8000 LSB
+            int64_t value = (int64_t)raw * MagnetometerAdjustment[i] * 1500 / 256 - (int64_t)MagnetometerBias[i] * 1000;
+            values[i]->Value = fixed3_t::FromRaw(FixedSaturate(value));
+        }
+    }
+
+    void Report(const TActorContext& context) {
+        TStatistics s = Statistics;
+        Statistics = {};
+        if (s.Count != 0) {
+            TSensorValueFixed3* accelerometer[3] = {&Accelerometer.X, &Accelerometer.Y, &Accelerometer.Z};
+            TSensorValueFixed3* gyroscope[3] = {&Gyroscope.X, &Gyroscope.Y, &Gyroscope.Z};
+            for (uint8_t i = 0; i < 3; ++i) {
+                accelerometer[i]->Value = fixed3_t::FromRaw((int32_t)(s.Acceleration[i] * 1000000 / ((int64_t)AccelerometerLSBPerG * s.Count)));
+                gyroscope[i]->Value = fixed3_t::FromRaw((int32_t)(s.Rotation[i] * 10000 / ((int64_t)GyroscopeLSBPerDPS10 * 256 * s.Count)));
+            }
+            float roll, pitch, yaw;
+            Filter.GetAngles(roll, pitch, yaw);
+            Roll.Value = fixed3_t(roll);
+            Pitch.Value = fixed3_t(pitch);
+            Yaw.Value = fixed3_t(yaw);
+            AccelerationPeak.Value = fixed3_t::FromRaw((int32_t)((int64_t)s.MagnitudePeak * 1000 / AccelerometerLSBPerG));
+            Vibration.Value = fixed3_t::FromRaw((int32_t)((int64_t)TRMSAccumulator::GetRMS(s.Magnitude, s.MagnitudeSquares, s.Count) * 1000 / (AccelerometerLSBPerG * 256)));
+            RotationPeak.Value = fixed3_t::FromRaw((int32_t)((int64_t)ISqrt(s.RotationPeakSquares) * 10000 / (GyroscopeLSBPerDPS10 * 256)));
+            Updated = context.Now;
+        }
+        if (HasMagnetometer) {
+            ReadMagnetometer();
+        }
+        int16_t temperature;
+        if (Env::Wire::ReadValue(AddressMPU6500, ERegisters::MPU9250_TEMP_OUT_H, temperature)) {
+            // 333.87 LSB per C, 0 at 21 C
+            Temperature.Value = fixed3_t::FromRaw((int32_t)temperature * 100000 / 33387 + 21000);
+        }
+        if (Env::SensorsSendValues && s.Count != 0) {
+            context.Send(this, Owner, new AW::TEventSensorData(*this, Accelerometer.X));
+            context.Send(this, Owner, new AW::TEventSensorData(*this, Accelerometer.Y));
+            context.Send(this, Owner, new AW::TEventSensorData(*this, Accelerometer.Z));
+            context.Send(this, Owner, new AW::TEventSensorData(*this, Gyroscope.X));
+            context.Send(this, Owner, new AW::TEventSensorData(*this, Gyroscope.Y));
+            context.Send(this, Owner, new AW::TEventSensorData(*this, Gyroscope.Z));
+            if (HasMagnetometer) {
                 context.Send(this, Owner, new AW::TEventSensorData(*this, Magnetometer.X));
                 context.Send(this, Owner, new AW::TEventSensorData(*this, Magnetometer.Y));
                 context.Send(this, Owner, new AW::TEventSensorData(*this, Magnetometer.Z));
-                context.Send(this, Owner, new AW::TEventSensorData(*this, Temperature));
             }
+            context.Send(this, Owner, new AW::TEventSensorData(*this, Roll));
+            context.Send(this, Owner, new AW::TEventSensorData(*this, Pitch));
+            context.Send(this, Owner, new AW::TEventSensorData(*this, Yaw));
+            context.Send(this, Owner, new AW::TEventSensorData(*this, AccelerationPeak));
+            context.Send(this, Owner, new AW::TEventSensorData(*this, Vibration));
+            context.Send(this, Owner, new AW::TEventSensorData(*this, RotationPeak));
+            context.Send(this, Owner, new AW::TEventSensorData(*this, Temperature));
         }
+    }
 
-        event->NotBefore = context.Now + Env::SensorsPeriod;
+    void OnReceive(AW::TUniquePtr<AW::TEventReceive> event, const AW::TActorContext& context) {
+        if (!Drain()) {
+            ++Overflows;
+            if (Env::Diagnostics) {
+                context.Send(this, Owner, new AW::TEventSensorMessage(*this, StringStream() << "FIFO overflow x" << Overflows));
+            }
+        }
+        if (context.Now - LastReport >= Env::SensorsPeriod) {
+            Report(context);
+            LastReport = context.Now;
+        }
+        event->NotBefore = context.Now + GetDrainPeriod();
         context.Resend(this, event.Release());
     }
 };
@@ -1,33 +1,68 @@
 #pragma once
 
-#include "ArduinoWorkflow.h"
+#include "aw.h"
+#include "aw-interrupt.h"
 
 namespace AW {
 
-template <typename Env = TDefaultEnvironment>
-class TSensorSonar : public TActor {
+// ultrasonic range finders (HC-SR04 and alike), up to MaxSonars of them fired round-robin, one every PingPeriod,
+// so the echo of one never reaches the other, the echo pulse is timed in the pin interrupt (TPinInterrupts),
+// nothing waits for it, the result is taken at the next slot
+// every sonar keeps the median of the last MedianSize echoes, reported as the distance (m) every SensorsPeriod,
+// the distance is cleared if there was no echo during the period
+// with any sonar added it holds a StandbyLock, the echo edges and micros() don't go on in the standby
+template <typename Env = TDefaultEnvironment, uint8_t MaxSonars = 4, int MedianSize = 5>
+class TSensorSonar : public TActor, public TSensorSource {
 public:
     TActor* Owner;
-    TSensor<1> Sensor;
-
-    enum ESensor {
-        Distance
+    TTime PingPeriod = TTime::MilliSeconds(50);
+
+    struct TSonar {
+        uint8_t TriggerPin;
+        uint8_t EchoPin;
+        volatile uint32_t Start;
+        volatile uint32_t End;
+        volatile bool Done;
+        bool Fresh;
+        TMovingMedian<long, MedianSize> Median; // us
+        TSensorValueFixed3 Distance;
     };
 
-    TSensorSonar(uint8_t triggerPin, uint8_t echoPin, TActor* owner, StringBuf name = "sonar")
+    TSonar Sonars[MaxSonars];
+
+    TSensorSonar(TActor* owner, StringBuf name = "sonar")
         : Owner(owner)
-        , PinTrigger(triggerPin, OUTPUT)
-        , PinEcho(echoPin, INPUT)
     {
-        Sensor.Name = name;
-        Sensor.Values[ESensor::Distance].Name = "distance";
+        Name = name;
+    }
+
+    TSensorSonar(uint8_t triggerPin, uint8_t echoPin, TActor* owner, StringBuf name = "sonar")
+        : TSensorSonar(owner, name)
+    {
+        AddSonar(triggerPin, echoPin);
+    }
+
+    // returns index of the sonar or -1, all sonars should be added before the bootstrap
+    int8_t AddSonar(uint8_t triggerPin, uint8_t echoPin, StringBuf name = "distance") {
+        if (SonarCount >= MaxSonars) {
+            return -1;
+        }
+        TSonar& sonar(Sonars[SonarCount]);
+        sonar.TriggerPin = triggerPin;
+        sonar.EchoPin = echoPin;
+        sonar.Distance.Name = name;
+        return SonarCount++;
     }
 
 protected:
-    TDigitalPin PinTrigger;
-    TDigitalPin PinEcho;
-    volatile unsigned long StartTime = 0;
-    volatile unsigned long EndTime = 0;
+    // no obstacle is ~38 ms echo, anything above ~4.3 m is out of range anyway
+    static constexpr uint32_t MaxEcho = 25000;
+    // round trip at 343 m/s is 5.8 us per mm
+    static constexpr uint32_t MicroSecondsPerMeter10 = 58;
+
+    uint8_t SonarCount = 0;
+    uint8_t Current = 0;
+    TTime LastReport;
 
     void OnEvent(TEventPtr event, const TActorContext& context) override {
         switch (event->EventID) {
@@ -41,58 +76,85 @@ protected:
     }
 
     void OnBootstrap(TUniquePtr<TEventBootstrap>, const TActorContext& context) {
-        This() = this;
-        attachInterrupt(digitalPinToInterrupt(PinEcho.GetPin()), StaticInterrupt, CHANGE);
-        context.Send(this, this, new TEventReceive());
-    }
-
-    void Send(const TActorContext& context) {
-        auto value = EndTime - StartTime;
-        if (value < 100000) {
-            Sensor.Values[ESensor::Distance].Value = double(value) / 5800;
-            Sensor.Updated = context.Now;
-            if (Env::SensorsSendValues) {
-                context.Send(this, Owner, new TEventSensorData(Sensor, Sensor.Values[ESensor::Distance]));
+        for (uint8_t i = 0; i < SonarCount; ++i) {
+            TSonar& sonar(Sonars[i]);
+            pinMode(sonar.TriggerPin, OUTPUT);
+            digitalWrite(sonar.TriggerPin, LOW);
+            pinMode(sonar.EchoPin, INPUT);
+            sonar.Done = false;
+            sonar.Fresh = false;
+            if (!TPinInterrupts::Attach(sonar.EchoPin, CHANGE, StaticEcho, &sonar) && Env::Diagnostics) {
+                context.Send(this, Owner, new TEventSensorMessage(*this, StringStream() << "No free interrupt slot for " << sonar.Distance.Name));
             }
         }
+        if (SonarCount != 0) {
+            ++context.ActorLib.StandbyLocks;
+            LastReport = context.Now;
+            Ping(Sonars[Current]);
+            context.Send(this, this, new TEventReceive(context.Now + PingPeriod));
+        }
     }
 
-    void OnReceive(TUniquePtr<TEventReceive> event, const TActorContext& context) {
-        if (EndTime > StartTime) {
-            Send(context);
-        }
-        StartTime = 0;
-        EndTime = 0;
-        PinTrigger = true;
+    static void Ping(TSonar& sonar) {
+        noInterrupts();
+        sonar.Start = 0;
+        sonar.End = 0;
+        sonar.Done = false;
+        interrupts();
+        digitalWrite(sonar.TriggerPin, HIGH);
         delayMicroseconds(10);
-        PinTrigger = false;
-        delay(10);
-        if (EndTime > StartTime) {
-            Send(context);
-            StartTime = 0;
-            EndTime = 0;
-        }
+        digitalWrite(sonar.TriggerPin, LOW);
+    }
 
-        event->NotBefore = context.Now + Env::SensorsPeriod;
-        context.Resend(this, event.Release());
+    static void Collect(TSonar& sonar) {
+        if (sonar.Done) {
+            uint32_t echo = sonar.End - sonar.Start;
+            if (echo < MaxEcho) {
+                sonar.Median.AddValue((long)echo);
+                sonar.Fresh = true;
+            }
+        }
     }
 
-    void Interrupt() {
-        auto time = micros();
-        bool value = PinEcho;
-        if (value) {
-            StartTime = time;
-        } else {
-            EndTime = time;
+    void Report(const TActorContext& context) {
+        for (uint8_t i = 0; i < SonarCount; ++i) {
+            TSonar& sonar(Sonars[i]);
+            if (sonar.Fresh) {
+                sonar.Distance.Value = fixed3_t::FromRaw((int32_t)(sonar.Median.GetValue() * 10 / MicroSecondsPerMeter10));
+                sonar.Fresh = false;
+                Updated = context.Now;
+                if (Env::SensorsSendValues) {
+                    context.Send(this, Owner, new TEventSensorData(*this, sonar.Distance));
+                }
+            } else {
+                sonar.Median.Clear();
+                sonar.Distance.Clear();
+            }
         }
     }
 
-    static TSensorSonar*& This() { static TSensorSonar* _this; return _this; }
+    void OnReceive(TUniquePtr<TEventReceive> event, const TActorContext& context) {
+        Collect(Sonars[Current]);
+        if (context.Now - LastReport >= Env::SensorsPeriod) {
+            Report(context);
+            LastReport = context.Now;
+        }
+        Current = (Current + 1) % SonarCount;
+        Ping(Sonars[Current]);
+        event->NotBefore = context.Now + PingPeriod;
+        context.Resend(this, event.Release());
+    }
 
-    static void StaticInterrupt() {
-        This()->Interrupt();
+    static void StaticEcho(void* context) {
+        TSonar& sonar(*static_cast<TSonar*>(context));
+        uint32_t time = micros();
+        if (digitalRead(sonar.EchoPin) == HIGH) {
+            sonar.Start = time;
+        } else if (sonar.Start != 0) {
+            sonar.End = time;
+            sonar.Done = true;
+        }
     }
 };
 
-
 }
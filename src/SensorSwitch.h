@@ -1,37 +1,41 @@
 #pragma once
 
 #include "aw.h"
+#include "aw-interrupt.h"
 
 namespace AW {
 
+// switch or contact to the ground (the pin is pulled up, closed is 1), edge-triggered:
+// the pin interrupt only signals the actor (and wakes it from the sleep), the first signal schedules
+// a single check after Debounce, the bounces before it are ignored and the check reads the settled state,
+// so there are no wake-ups while the contact doesn't move
+// on AVR the power-down stops clk_I/O and the edges of INT0/1 aren't detected there, so it holds a StandbyLock
 template <typename Env = TDefaultEnvironment>
-class TSensorSwitch : public TActor {
+class TSensorSwitch : public TActor, public TSensorSource {
 public:
     TActor* Owner;
-    TSensor<1> Sensor;
+    TTime Debounce = TTime::MilliSeconds(50);
+    TSensorValueFixed3 Switch;
     bool Value = false;
 
-    enum ESensor {
-        Switch,
-    };
-    
     TSensorSwitch(uint8_t pin, TActor* owner, StringBuf name = "switch")
         : Owner(owner)
-        , PinValue(pin, INPUT_PULLUP)
+        , Pin(pin)
     {
-        Sensor.Name = name;
-        Sensor.Values[ESensor::Switch].Name = "switch";
-
+        Name = name;
+        Switch.Name = "switch";
     }
 
 protected:
-    static constexpr TTime Resolution = TTime::MilliSeconds(100);
-    TDigitalPin PinValue;
-    
+    uint8_t Pin;
+    bool CheckPending = false;
+
     void OnEvent(TEventPtr event, const TActorContext& context) override {
         switch (event->EventID) {
         case TEventBootstrap::EventID:
             return OnBootstrap(static_cast<TEventBootstrap*>(event.Release()), context);
+        case TEventSignal::EventID:
+            return OnSignal(static_cast<TEventSignal*>(event.Release()), context);
         case TEventReceive::EventID:
             return OnReceive(static_cast<TEventReceive*>(event.Release()), context);
         default:
@@ -40,21 +44,47 @@ protected:
     }
 
     void OnBootstrap(TUniquePtr<TEventBootstrap>, const TActorContext& context) {
-        Value = !PinValue;
-        context.Send(this, this, new TEventReceive());
-    }
-
-    void OnReceive(TUniquePtr<TEventReceive> event, const TActorContext& context) {
-        Value = !PinValue;
-        if (Value != Sensor.Values[ESensor::Switch].Value.GetValue()) {
-            Sensor.Values[ESensor::Switch].Value.SetValue(Value);
-            Sensor.Updated = context.Now;
-            if (Env::SensorsSendValues) {
-                context.Send(this, Owner, new TEventSensorData(Sensor, Sensor.Values[ESensor::Switch]));
-            }
+        pinMode(Pin, INPUT_PULLUP);
+        if (TPinInterrupts::Attach(Pin, CHANGE, StaticChange, this, true)) {
+#ifdef ARDUINO_ARCH_AVR
+            ++context.ActorLib.StandbyLocks;
+#endif
+        } else if (Env::Diagnostics) {
+            context.Send(this, Owner, new TEventSensorMessage(*this, StringStream() << "No free interrupt slot"));
+        }
+        Update(IsClosed(), context);
+    }
+
+    void OnSignal(TUniquePtr<TEventSignal>, const TActorContext& context) {
+        if (!CheckPending) {
+            CheckPending = true;
+            context.Send(this, this, new TEventReceive(context.Now + Debounce));
+        }
+    }
+
+    void OnReceive(TUniquePtr<TEventReceive>, const TActorContext& context) {
+        CheckPending = false;
+        bool value = IsClosed();
+        if (value != Value) {
+            Update(value, context);
         }
-        event->NotBefore = context.Now + Resolution;
-        context.Resend(this, event.Release());
+    }
+
+    bool IsClosed() const {
+        return digitalRead(Pin) == LOW;
+    }
+
+    void Update(bool value, const TActorContext& context) {
+        Value = value;
+        Switch.Value = fixed3_t(Value ? 1 : 0);
+        Updated = context.Now;
+        if (Env::SensorsSendValues) {
+            context.Send(this, Owner, new TEventSensorData(*this, Switch));
+        }
+    }
+
+    static void StaticChange(void* context) {
+        static_cast<TSensorSwitch*>(context)->Signal();
     }
 };
 
@@ -0,0 +1,274 @@
+#include <Arduino.h>
+#include "aw.h"
+#include "aw-adc.h"
+#ifdef ARDUINO_ARCH_SAMD
+#include <wiring_private.h>
+#endif
+
+namespace AW {
+
+TADCSampler::TChannel TADCSampler::Channels[TADCSampler::MaxChannels];
+uint8_t TADCSampler::ChannelCount = 0;
+volatile uint8_t TADCSampler::Current = 0;
+volatile bool TADCSampler::Running = false;
+volatile uint32_t TADCSampler::Samples = 0;
+uint8_t TADCSampler::Oversampling = 0;
+TActorLib* TADCSampler::StandbyLib = nullptr;
+
+int8_t TADCSampler::AddChannel(uint8_t pin, TSink sink, void* context) {
+    if (ChannelCount >= MaxChannels) {
+        return -1;
+    }
+    // the interrupt walks the channels, it's stopped while the table changes
+    bool running = Running;
+    if (running) {
+        Stop();
+    }
+    SetupPin(pin);
+    TChannel& channel(Channels[ChannelCount]);
+    channel.Pin = pin;
+    channel.Sink = sink;
+    channel.SinkContext = context;
+    int8_t index = ChannelCount++;
+    if (running) {
+        Begin(Oversampling);
+    }
+    return index;
+}
+
+uint16_t TADCSampler::AnalogRead(uint8_t pin) {
+    bool running = Running;
+    if (running) {
+        Stop();
+    }
+    uint16_t value = analogRead(pin);
+    if (running) {
+        Begin(Oversampling);
+    }
+    return value;
+}
+
+void TADCSampler::Begin(TActorLib& lib, uint8_t oversampling) {
+    if (!Running) {
+        Begin(oversampling);
+    }
+    if (Running && StandbyLib == nullptr) {
+        StandbyLib = &lib;
+        ++lib.StandbyLocks;
+    }
+}
+
+void TADCSampler::End() {
+    Stop();
+    if (StandbyLib != nullptr) {
+        --StandbyLib->StandbyLocks;
+        StandbyLib = nullptr;
+    }
+}
+
+uint16_t TADCSampler::Take(uint8_t channel, uint32_t& sum) {
+    TChannel& c(Channels[channel]);
+    noInterrupts();
+    sum = c.Sum;
+    uint16_t count = c.Count;
+    c.Sum = 0;
+    c.Count = 0;
+    interrupts();
+    return count;
+}
+
+uint16_t TADCSampler::GetLast(uint8_t channel) {
+    return Channels[channel].Last;
+}
+
+void TADCSampler::OnSample(uint16_t value) {
+    TChannel& c(Channels[Current]);
+    c.Last = value;
+    if (c.Count != 0xffff) {
+        c.Sum += value;
+        ++c.Count;
+    }
+    if (c.Sink != nullptr) {
+        c.Sink(c.SinkContext, value);
+    }
+    ++Samples;
+    uint8_t next = Current + 1;
+    if (next >= ChannelCount) {
+        next = 0;
+    }
+    Current = next;
+    if (Running) {
+        StartConversion(next);
+    }
+}
+
+uint16_t TADCSampler::ReadSoftware(uint8_t pin) {
+    uint32_t sum = 0;
+    uint16_t count = 1 << Oversampling;
+    for (uint16_t i = 0; i < count; ++i) {
+        sum += analogRead(pin);
+    }
+    return sum >> Oversampling;
+}
+
+#if defined(ARDUINO_ARCH_SAMD) && !defined(AW_NO_ADC_INTERRUPT)
+
+static void SyncADC() {
+    while (ADC->STATUS.bit.SYNCBUSY) {}
+}
+
+// analogRead() settings, restored by Stop()
+static uint16_t SavedCTRLB;
+static uint8_t SavedAVGCTRL;
+
+void TADCSampler::Begin(uint8_t oversampling) {
+    if (ChannelCount == 0) {
+        return;
+    }
+    Oversampling = oversampling > 10 ? 10 : oversampling;
+    // the channels added by the global constructors were reset to digital inputs by init() since
+    for (uint8_t i = 0; i < ChannelCount; ++i) {
+        SetupPin(Channels[i].Pin);
+    }
+    NVIC_DisableIRQ(ADC_IRQn);
+    ADC->CTRLA.bit.ENABLE = 0;
+    SyncADC();
+    SavedCTRLB = ADC->CTRLB.reg;
+    SavedAVGCTRL = ADC->AVGCTRL.reg;
+    // averaging needs 16-bit result, ADJRES divides the sum by up to 16
+    ADC->CTRLB.reg = ADC_CTRLB_PRESCALER_DIV64 | (Oversampling > 0 ? ADC_CTRLB_RESSEL_16BIT : ADC_CTRLB_RESSEL_12BIT);
+    SyncADC();
+    ADC->AVGCTRL.reg = ADC_AVGCTRL_SAMPLENUM(Oversampling) | ADC_AVGCTRL_ADJRES(Oversampling < 4 ? Oversampling : 4);
+    ADC->INTFLAG.reg = ADC_INTFLAG_RESRDY;
+    ADC->INTENSET.reg = ADC_INTENSET_RESRDY;
+    NVIC_ClearPendingIRQ(ADC_IRQn);
+    NVIC_SetPriority(ADC_IRQn, 3);
+    NVIC_EnableIRQ(ADC_IRQn);
+    ADC->CTRLA.bit.ENABLE = 1;
+    SyncADC();
+    Running = true;
+    Current = 0;
+    StartConversion(0);
+}
+
+void TADCSampler::Stop() {
+    Running = false;
+    ADC->INTENCLR.reg = ADC_INTENCLR_RESRDY;
+    NVIC_DisableIRQ(ADC_IRQn);
+    ADC->CTRLA.bit.ENABLE = 0;
+    SyncADC();
+    ADC->AVGCTRL.reg = SavedAVGCTRL;
+    ADC->CTRLB.reg = SavedCTRLB;
+    SyncADC();
+}
+
+void TADCSampler::StartConversion(uint8_t channel) {
+    ADC->INPUTCTRL.bit.MUXPOS = g_APinDescription[Channels[channel].Pin].ulADCChannelNumber;
+    SyncADC();
+    ADC->SWTRIG.bit.START = 1;
+}
+
+void TADCSampler::Poll() {}
+
+void TADCSampler::SetupPin(uint8_t pin) {
+    pinPeripheral(pin, PIO_ANALOG);
+}
+
+#elif defined(ARDUINO_ARCH_AVR) && !defined(AW_NO_ADC_INTERRUPT)
+
+// software oversampling: the channel stays selected until 2^Oversampling conversions are summed
+static uint16_t AVRSum = 0;
+static uint8_t AVRCount = 0;
+// REFS bits of ADMUX, analogReference() only keeps the mode in the core until the next analogRead()
+static uint8_t AVRReference = _BV(REFS0);
+
+void TADCSampler::Begin(uint8_t oversampling) {
+    if (ChannelCount == 0) {
+        return;
+    }
+    Oversampling = oversampling > 6 ? 6 : oversampling;
+    // the reference set by analogReference() is applied by analogRead(), and taken from ADMUX then
+    analogRead(Channels[0].Pin);
+    AVRReference = ADMUX & (_BV(REFS1) | _BV(REFS0));
+    AVRSum = 0;
+    AVRCount = 0;
+    Running = true;
+    Current = 0;
+    StartConversion(0);
+}
+
+void TADCSampler::Stop() {
+    Running = false;
+    ADCSRA &= ~_BV(ADIE);
+}
+
+void TADCSampler::StartConversion(uint8_t channel) {
+    uint8_t pin = Channels[channel].Pin;
+#ifdef analogPinToChannel
+    pin = analogPinToChannel(pin >= A0 ? pin - A0 : pin);
+#else
+    pin = pin >= A0 ? pin - A0 : pin;
+#endif
+#ifdef MUX5
+    // channels 8..15 of the Mega
+    ADCSRB = (ADCSRB & ~_BV(MUX5)) | ((pin >> 3) & 0x01) << MUX5;
+#endif
+    ADMUX = AVRReference | (pin & 0x07);
+    ADCSRA = _BV(ADEN) | _BV(ADIE) | _BV(ADSC) | _BV(ADPS2) | _BV(ADPS1) | _BV(ADPS0);
+}
+
+void TADCSampler::Poll() {}
+
+void TADCSampler::SetupPin(uint8_t) {}
+
+#else
+
+// no ADC interrupt, the samples are taken by Poll() with analogRead()
+void TADCSampler::Begin(uint8_t oversampling) {
+    Oversampling = oversampling > 10 ? 10 : oversampling;
+    Current = 0;
+}
+
+void TADCSampler::Stop() {}
+
+void TADCSampler::StartConversion(uint8_t) {}
+
+void TADCSampler::Poll() {
+    for (uint8_t i = 0; i < ChannelCount; ++i) {
+        OnSample(ReadSoftware(Channels[Current].Pin));
+    }
+}
+
+void TADCSampler::SetupPin(uint8_t) {}
+
+#endif
+
+}
+
+#if defined(ARDUINO_ARCH_SAMD) && !defined(AW_NO_ADC_INTERRUPT)
+void ADC_Handler() {
+    uint16_t value = ADC->RESULT.reg;
+    ADC->INTFLAG.reg = ADC_INTFLAG_RESRDY;
+    // above 16 samples the hardware keeps the extra bits, the result is always 12-bit here
+    uint8_t oversampling = AW::TADCSampler::GetOversampling();
+    if (oversampling > 4) {
+        value >>= oversampling - 4;
+    }
+    AW::TADCSampler::OnSample(value);
+}
+#endif
+
+#if defined(ARDUINO_ARCH_AVR) && !defined(AW_NO_ADC_INTERRUPT)
+ISR(ADC_vect) {
+    AVRSum += ADC;
+    uint8_t oversampling = AW::TADCSampler::GetOversampling();
+    if (++AVRCount >= (1 << oversampling)) {
+        uint16_t value = AVRSum >> oversampling;
+        AVRSum = 0;
+        AVRCount = 0;
+        AW::TADCSampler::OnSample(value);
+    } else {
+        ADCSRA |= _BV(ADSC);
+    }
+}
+#endif
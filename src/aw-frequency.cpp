@@ -0,0 +1,150 @@
+#include <Arduino.h>
+#include "aw.h"
+#include "aw-frequency.h"
+#include "aw-interrupt.h"
+#ifdef ARDUINO_ARCH_SAMD
+#include <wiring_private.h>
+#endif
+
+namespace AW {
+
+void TFrequencyCounter::OnEdge(void* context) {
+    ++static_cast<TFrequencyCounter*>(context)->Total;
+}
+
+#ifdef ARDUINO_ARCH_SAMD
+
+static Tc* GetTimer(uint8_t timer) {
+    switch (timer) {
+    case 3:
+        return TC3;
+    case 4:
+        return TC4;
+    case 5:
+        return TC5;
+    default:
+        return nullptr;
+    }
+}
+
+static void SyncEIC() {
+    while (EIC->STATUS.bit.SYNCBUSY) {}
+}
+
+static void SyncTC(Tc* tc) {
+    while (tc->COUNT16.STATUS.bit.SYNCBUSY) {}
+}
+
+bool TFrequencyCounter::Begin() {
+    Tc* tc = GetTimer(Timer);
+    int8_t line = g_APinDescription[Pin].ulExtInt;
+    if (tc == nullptr || line < 0) {
+        return false;
+    }
+    pinMode(Pin, INPUT);
+    pinPeripheral(Pin, PIO_EXTINT);
+
+    // EIC: rising edge of the line generates an event, no interrupt
+    GCLK->CLKCTRL.reg = GCLK_CLKCTRL_ID_EIC | GCLK_CLKCTRL_GEN_GCLK0 | GCLK_CLKCTRL_CLKEN;
+    while (GCLK->STATUS.bit.SYNCBUSY) {}
+    EIC->CTRL.bit.ENABLE = 0;
+    SyncEIC();
+    uint8_t shift = (line % 8) * 4;
+    EIC->CONFIG[line / 8].reg = (EIC->CONFIG[line / 8].reg & ~(EIC_CONFIG_SENSE0_Msk << shift)) | (EIC_CONFIG_SENSE0_RISE << shift);
+    EIC->INTENCLR.reg = 1 << line;
+    EIC->EVCTRL.reg |= 1 << line;
+    EIC->CTRL.bit.ENABLE = 1;
+    SyncEIC();
+
+    // EVSYS: asynchronous path, the TC sees every edge without any clock of the channel
+    PM->APBCMASK.reg |= PM_APBCMASK_EVSYS;
+    EVSYS->USER.reg = EVSYS_USER_CHANNEL(Channel + 1) | EVSYS_USER_USER(EVSYS_ID_USER_TC3_EVU + Timer - 3);
+    EVSYS->CHANNEL.reg = EVSYS_CHANNEL_CHANNEL(Channel) | EVSYS_CHANNEL_PATH_ASYNCHRONOUS | EVSYS_CHANNEL_EVGEN(EVSYS_ID_GEN_EIC_EXTINT_0 + line);
+
+    // TC: 16-bit counter of the events
+    PM->APBCMASK.reg |= PM_APBCMASK_TC3 << (Timer - 3);
+    GCLK->CLKCTRL.reg = (Timer == 3 ? GCLK_CLKCTRL_ID_TCC2_TC3 : GCLK_CLKCTRL_ID_TC4_TC5) | GCLK_CLKCTRL_GEN_GCLK0 | GCLK_CLKCTRL_CLKEN;
+    while (GCLK->STATUS.bit.SYNCBUSY) {}
+    tc->COUNT16.CTRLA.reg = TC_CTRLA_SWRST;
+    while (tc->COUNT16.CTRLA.bit.SWRST) {}
+    tc->COUNT16.CTRLA.reg = TC_CTRLA_MODE_COUNT16 | TC_CTRLA_PRESCALER_DIV1;
+    tc->COUNT16.EVCTRL.reg = TC_EVCTRL_TCEI | TC_EVCTRL_EVACT_COUNT;
+    tc->COUNT16.CTRLA.bit.ENABLE = 1;
+    SyncTC(tc);
+    LastCount = 0;
+    Total = 0;
+    return true;
+}
+
+void TFrequencyCounter::End() {
+    Tc* tc = GetTimer(Timer);
+    int8_t line = g_APinDescription[Pin].ulExtInt;
+    if (tc == nullptr || line < 0) {
+        return;
+    }
+    tc->COUNT16.CTRLA.bit.ENABLE = 0;
+    SyncTC(tc);
+    EVSYS->USER.reg = EVSYS_USER_CHANNEL(0) | EVSYS_USER_USER(EVSYS_ID_USER_TC3_EVU + Timer - 3);
+    EIC->CTRL.bit.ENABLE = 0;
+    SyncEIC();
+    EIC->EVCTRL.reg &= ~(1 << line);
+    EIC->CTRL.bit.ENABLE = 1;
+    SyncEIC();
+}
+
+uint32_t TFrequencyCounter::Read() {
+    Tc* tc = GetTimer(Timer);
+    if (tc == nullptr) {
+        return Total;
+    }
+    tc->COUNT16.READREQ.reg = TC_READREQ_RREQ | TC_READREQ_ADDR(TC_COUNT16_COUNT_OFFSET);
+    SyncTC(tc);
+    uint16_t count = tc->COUNT16.COUNT.reg;
+    Total += (uint16_t)(count - LastCount);
+    LastCount = count;
+    return Total;
+}
+
+#elif defined(ARDUINO_ARCH_AVR)
+
+bool TFrequencyCounter::Begin() {
+    pinMode(Pin, INPUT);
+    Total = 0;
+    return TPinInterrupts::Attach(Pin, RISING, OnEdge, this);
+}
+
+void TFrequencyCounter::End() {
+    TPinInterrupts::Detach(Pin);
+}
+
+uint32_t TFrequencyCounter::Read() {
+    noInterrupts();
+    uint32_t total = Total;
+    interrupts();
+    return total;
+}
+
+#else
+
+bool TFrequencyCounter::Begin() {
+    Total = 0;
+    SimulatedRemainder = 0;
+    LastTime = micros();
+    return true;
+}
+
+void TFrequencyCounter::End() {}
+
+// edges of SimulatedFrequency since the last call, the fraction of an edge is carried over
+uint32_t TFrequencyCounter::Read() {
+    uint32_t now = micros();
+    uint64_t edges = (uint64_t)SimulatedFrequency * (now - LastTime) + SimulatedRemainder;
+    LastTime = now;
+    Total += (uint32_t)(edges / 1000000);
+    SimulatedRemainder = (uint32_t)(edges % 1000000);
+    return Total;
+}
+
+#endif
+
+}
@@ -0,0 +1,84 @@
+#include <Arduino.h>
+#include "aw.h"
+#include "aw-interrupt.h"
+
+namespace AW {
+
+TPinInterrupts::TSlot TPinInterrupts::Slots[TPinInterrupts::MaxSlots];
+
+void (* const TPinInterrupts::Trampolines[TPinInterrupts::MaxSlots])() = {
+    &TPinInterrupts::Trampoline<0>,
+    &TPinInterrupts::Trampoline<1>,
+    &TPinInterrupts::Trampoline<2>,
+    &TPinInterrupts::Trampoline<3>,
+    &TPinInterrupts::Trampoline<4>,
+    &TPinInterrupts::Trampoline<5>,
+    &TPinInterrupts::Trampoline<6>,
+    &TPinInterrupts::Trampoline<7>,
+};
+
+int8_t TPinInterrupts::FindSlot(uint8_t pin) {
+    int8_t free = -1;
+    for (uint8_t i = 0; i < MaxSlots; ++i) {
+        if (Slots[i].Handler == nullptr) {
+            if (free < 0) {
+                free = i;
+            }
+        } else if (Slots[i].Pin == pin) {
+            return i;
+        }
+    }
+    return free;
+}
+
+bool TPinInterrupts::Attach(uint8_t pin, int mode, THandler handler, void* context, bool wakeUp) {
+    int8_t index = FindSlot(pin);
+    if (index < 0) {
+        return false;
+    }
+    TSlot& slot(Slots[index]);
+    noInterrupts();
+    slot.Pin = pin;
+    slot.Handler = handler;
+    slot.Context = context;
+    interrupts();
+    attachInterrupt(digitalPinToInterrupt(pin), Trampolines[index], mode);
+    if (wakeUp) {
+        EnableWakeUp(pin);
+    }
+    return true;
+}
+
+void TPinInterrupts::Detach(uint8_t pin) {
+    int8_t index = FindSlot(pin);
+    if (index >= 0 && Slots[index].Handler != nullptr) {
+        detachInterrupt(digitalPinToInterrupt(pin));
+        Slots[index].Handler = nullptr;
+    }
+}
+
+#ifdef ARDUINO_ARCH_SAMD
+
+void TPinInterrupts::EnableWakeUp(uint8_t pin) {
+    int8_t line = g_APinDescription[pin].ulExtInt;
+    if (line < 0) {
+        return;
+    }
+    // GCLK6 from OSCULP32K runs in standby, the edge detection of the EIC needs its clock there
+    GCLK->GENDIV.reg = GCLK_GENDIV_ID(6);
+    GCLK->GENCTRL.reg = GCLK_GENCTRL_ID(6) | GCLK_GENCTRL_SRC_OSCULP32K | GCLK_GENCTRL_GENEN | GCLK_GENCTRL_RUNSTDBY;
+    while (GCLK->STATUS.bit.SYNCBUSY) {}
+    GCLK->CLKCTRL.reg = GCLK_CLKCTRL_ID_EIC | GCLK_CLKCTRL_GEN_GCLK6 | GCLK_CLKCTRL_CLKEN;
+    while (GCLK->STATUS.bit.SYNCBUSY) {}
+    EIC->WAKEUP.reg |= 1 << line;
+}
+
+#else
+
+// AVR edge interrupts need clk_I/O, which the power-down stops: an edge there is lost, not delayed,
+// the actors which need the edges hold a StandbyLock, the lib idles instead of the power-down then
+void TPinInterrupts::EnableWakeUp(uint8_t) {}
+
+#endif
+
+}
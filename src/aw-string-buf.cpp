@@ -204,8 +204,7 @@ StringBuf StringBuf::NextToken(char delimeter) {
     return result;
 }
 
-uint16_t StringBuf::crc16() const {
-    uint16_t crc = 0xffff;
+uint16_t StringBuf::crc16(uint16_t crc) const {
     for (uint8_t c : *this) {
         crc ^= (uint16_t)c;                   // XOR byte into least sig. byte of crc
         for (int i = 8; i != 0; --i) {        // Loop over each bit
@@ -287,8 +286,8 @@ String::String(fixed3_t value)
 {
     char tmp[33];
     char* pcon = ConversionBuffer;
-    long val = value.raw();
-    if (val < 0) {
+    unsigned long val = (unsigned long)(long)value.raw();
+    if (value.raw() < 0) {
         val = -val;
         *pcon = '-';
         ++pcon;
@@ -2,6 +2,9 @@
 #include <Adafruit_SleepyDog.h>
 #include <Wire.h>
 #include "aw.h"
+#ifdef ARDUINO_ARCH_AVR
+#include <avr/sleep.h>
+#endif
 
 namespace AW {
 
@@ -9,8 +12,16 @@ TActorContext::TActorContext(TActorLib& actorLib)
     : ActorLib(actorLib)
     , Now(TTime::Now()) {}
 
+// the queue order is by NotBefore, an event due already is queued since now
+static void SetReleaseTime(TEvent& event, TTime now) {
+    if (event.NotBefore < now) {
+        event.NotBefore = now;
+    }
+}
+
 void TActorContext::Send(TActor* sender, TActor* recipient, TEventPtr event) const {
     event->Sender = sender;
+    SetReleaseTime(*event, Now);
     recipient->OnSend(Move(event), *this);
 }
 
@@ -21,14 +32,17 @@ void TActorContext::SendAfter(TActor* sender, TActor* recipient, TEventPtr event
 
 void TActorContext::SendImmediate(TActor* sender, TActor* recipient, TEventPtr event) const {
     event->Sender = sender;
+    SetReleaseTime(*event, Now);
     ActorLib.SendImmediate(recipient, Move(event));
 }
 
 void TActorContext::Resend(TActor* recipient, TEventPtr event) const {
+    SetReleaseTime(*event, Now);
     ActorLib.Resend(recipient, Move(event));
 }
 
 void TActorContext::ResendImmediate(TActor* recipient, TEventPtr event) const {
+    SetReleaseTime(*event, Now);
     ActorLib.ResendImmediate(recipient, Move(event));
 }
 
@@ -37,11 +51,45 @@ void TActorContext::ResendAfter(TActor* recipient, TEventPtr event, TTime time)
     Resend(recipient, Move(event));
 }
 
+volatile bool TActor::SignalPending = false;
+
+#ifdef ARDUINO_ARCH_SAMD
+// the sleep is measured by the RTC counting 1024 Hz from OSCULP32K, which runs in the standby,
+// the watchdog period is only the longest sleep, an interrupt (EIC wake-up) ends it earlier
+static void SyncRTC() {
+    while (RTC->MODE0.STATUS.bit.SYNCBUSY) {}
+}
+
+static void StartSleepClock() {
+    PM->APBAMASK.reg |= PM_APBAMASK_RTC;
+    // the same GCLK6 as the EIC wake-up in TPinInterrupts
+    GCLK->GENDIV.reg = GCLK_GENDIV_ID(6);
+    GCLK->GENCTRL.reg = GCLK_GENCTRL_ID(6) | GCLK_GENCTRL_SRC_OSCULP32K | GCLK_GENCTRL_GENEN | GCLK_GENCTRL_RUNSTDBY;
+    while (GCLK->STATUS.bit.SYNCBUSY) {}
+    GCLK->CLKCTRL.reg = GCLK_CLKCTRL_ID_RTC | GCLK_CLKCTRL_GEN_GCLK6 | GCLK_CLKCTRL_CLKEN;
+    while (GCLK->STATUS.bit.SYNCBUSY) {}
+    RTC->MODE0.CTRL.bit.ENABLE = 0;
+    SyncRTC();
+    RTC->MODE0.CTRL.reg = RTC_MODE0_CTRL_MODE_COUNT32 | RTC_MODE0_CTRL_PRESCALER_DIV32;
+    SyncRTC();
+    RTC->MODE0.CTRL.bit.ENABLE = 1;
+    SyncRTC();
+}
+
+static uint32_t ReadSleepClock() {
+    RTC->MODE0.READREQ.reg = RTC_READREQ_RREQ | RTC_READREQ_ADDR(0x10);
+    SyncRTC();
+    return RTC->MODE0.COUNT.reg;
+}
+#endif
+
 TActorLib::TActorLib() {
 #ifndef _DEBUG_SLEEP
 #ifdef ARDUINO_ARCH_SAMD
-    auto slept = Watchdog.sleep(10); // it will reset here first time after flash... don't know, why
-    SleepTime += TTime::MilliSeconds(slept);
+    StartSleepClock();
+    uint32_t start = ReadSleepClock();
+    Watchdog.sleep(10); // it will reset here first time after flash... don't know, why
+    AddSleep(ReadSleepClock() - start);
 #endif
 #endif
 #ifndef _DEBUG_WATCHDOG
@@ -66,42 +114,99 @@ void TActorLib::Register(TActor* actor, TTime drift) {
     Send(actor, Move(bootstrapEvent));
 }
 
+bool TActorLib::IsBefore(const TEvent& event, const TEvent& other) {
+    if (event.Priority != other.Priority) {
+        return event.Priority < other.Priority;
+    }
+    return event.NotBefore < other.NotBefore;
+}
+
+void TActorLib::ScanEvents(TActor* actor, TTime now) {
+    actor->FirstDue = nullptr;
+    actor->NextDue = TTime::Max();
+    actor->DueCount = 0;
+    actor->EventsChanged = false;
+    for (auto itEvent = actor->Events.begin(); itEvent != actor->Events.end(); ++itEvent) {
+        TEvent* event = itEvent.Get();
+        if (now < event->NotBefore) {
+            if (actor->NextDue > event->NotBefore) {
+                actor->NextDue = event->NotBefore;
+            }
+        } else {
+            ++actor->DueCount;
+            if (actor->FirstDue == nullptr || IsBefore(*event, *actor->FirstDue)) {
+                actor->FirstDue = event;
+            }
+        }
+    }
+}
+
 void TActorLib::Run() {
     TActorContext context(*this);
-    TActor* itActor = Actors;
     TTime nextEvent = TTime::Max();
 #ifndef _DEBUG_WATCHDOG
     Watchdog.reset();
 #endif
-    while (itActor != nullptr) {
-        auto& events(itActor->Events);
-        auto end(events.end());
-        auto itEvent = events.begin();
-        while (itEvent != events.end() && itEvent != end) {
-            TEventPtr event = events.pop_value(itEvent);
+    TActor::SignalPending = false;
+    for (TActor* itActor = Actors; itActor != nullptr; itActor = itActor->NextActor) {
+        if (itActor->Signalled) {
+            itActor->Signalled = false;
             TTime start = TTime::Now();
             context.Now = start + SleepTime;
-            if (context.Now < event->NotBefore) {
-                if (nextEvent > event->NotBefore) {
-                    nextEvent = event->NotBefore;
-                }
-                auto itEnd = events.push_back(Move(event));
-                if (end == events.end()) {
-                    end = itEnd;
-                }
-            } else {
-                nextEvent = TTime::Zero();
-                itActor->OnEvent(Move(event), context);
-                TTime spent = TTime::Now() - start;
-                itActor->BusyTime += spent;
-                BusyTime += spent;
-                if (itEvent != events.begin())
-                    break;
+            nextEvent = TTime::Zero();
+            TEventPtr signal = new TEventSignal();
+            signal->Sender = itActor;
+            itActor->OnEvent(Move(signal), context);
+            TTime spent = TTime::Now() - start;
+            itActor->BusyTime += spent;
+            BusyTime += spent;
+        }
+    }
+    // the due event to run first is selected across all actors every time, so a command sent during the run
+    // overtakes the sensors, the run is limited to the number of events due at its start,
+    // so an actor resending its event without a delay doesn't hold it forever
+    // only the queues which changed, or got a new due event, are scanned again, the rest is taken from the last scan
+    int limit = -1;
+    for (;;) {
+        TActor* firstActor = nullptr;
+        int due = 0;
+        TTime now = TTime::Now() + SleepTime;
+        for (TActor* itActor = Actors; itActor != nullptr; itActor = itActor->NextActor) {
+            if (itActor->EventsChanged || !(now < itActor->NextDue)) {
+                ScanEvents(itActor, now);
+            }
+            if (nextEvent > itActor->NextDue) {
+                nextEvent = itActor->NextDue;
+            }
+            due += itActor->DueCount;
+            if (itActor->FirstDue != nullptr && (firstActor == nullptr || IsBefore(*itActor->FirstDue, *firstActor->FirstDue))) {
+                firstActor = itActor;
             }
         }
-        itActor = itActor->NextActor;
+        if (limit < 0) {
+            limit = due;
+        }
+        if (firstActor == nullptr || limit-- == 0) {
+            break;
+        }
+        TList<TEventPtr>::Iterator itEvent(firstActor->FirstDue);
+        TEventPtr event = firstActor->Events.pop_value(itEvent);
+        firstActor->EventsChanged = true;
+        TTime start = TTime::Now();
+        context.Now = start + SleepTime;
+        nextEvent = TTime::Zero();
+        if (event->NotBefore != TTime()) {
+            TTime& maxLatency(MaxLatency[(uint8_t)event->Priority]);
+            if (maxLatency < context.Now - event->NotBefore) {
+                maxLatency = context.Now - event->NotBefore;
+            }
+        }
+        firstActor->OnEvent(Move(event), context);
+        TTime spent = TTime::Now() - start;
+        firstActor->BusyTime += spent;
+        BusyTime += spent;
     }
-    if (nextEvent != TTime::Zero()) {
+    if (nextEvent != TTime::Zero() && !TActor::SignalPending) {
         TTime now = TTime::Now() + SleepTime;
         TTime minSleep;
         if (nextEvent > now) {
@@ -115,7 +220,9 @@ void TActorLib::Run() {
         if (minSleep > MaxSleepPeriod) {
             minSleep = MaxSleepPeriod;
         }
-        if (minSleep >= MinSleepPeriod) {
+        if (minSleep >= MinSleepPeriod && StandbyLocks != 0) {
+            Idle(TTime::Now() + minSleep);
+        } else if (minSleep >= MinSleepPeriod) {
             auto sleep = minSleep.MilliSeconds();
 #ifndef _DEBUG_WATCHDOG
 //            Watchdog.disable();
@@ -123,8 +230,25 @@ void TActorLib::Run() {
 #ifdef _DEBUG_SLEEP
             delay(sleep);
 #else
+            // a signal raised after the check above would wait for the whole sleep, so it's checked again
+            // with the interrupts disabled, WFI still wakes up on the pending interrupt, which runs after interrupts()
+            noInterrupts();
+            if (TActor::SignalPending) {
+                interrupts();
+                return;
+            }
+#ifdef ARDUINO_ARCH_SAMD
+            uint32_t start = ReadSleepClock();
+            Watchdog.sleep(sleep);
+            AddSleep(ReadSleepClock() - start);
+            interrupts();
+#else
+            // the AVR edge interrupts aren't detected in the power-down at all (clk_I/O stops), only the watchdog
+            // wakes it, the actors which need the edges hold a StandbyLock and never get here
             auto slept = Watchdog.sleep(sleep);
+            interrupts();
             SleepTime += TTime::MilliSeconds(slept);
+#endif
 //            Serial.print("sleep "); Serial.print(sleep); Serial.print(" slept "); Serial.println(slept); Serial.flush();
 #endif
 #ifndef _DEBUG_WATCHDOG
@@ -138,12 +262,53 @@ void TActorLib::Run() {
     }
 }
 
+// ticks of 1/1024 s
+void TActorLib::AddSleep(uint32_t ticks) {
+    uint32_t value = ticks * 1000 + SleepRemainder;
+    SleepTime += TTime::MilliSeconds(value / 1024);
+    SleepRemainder = value % 1024;
+}
+
+void TActorLib::Idle(TTime until) {
+    // any interrupt wakes the CPU, the tick does it every millisecond,
+    // the signal is checked with the interrupts disabled, so it can't come between the check and the sleep
+    while (TTime::Now() < until) {
+#if defined(ARDUINO_ARCH_SAMD)
+        noInterrupts();
+        if (TActor::SignalPending) {
+            interrupts();
+            break;
+        }
+        // the watchdog sleep leaves the deep sleep bit set
+        SCB->SCR &= ~SCB_SCR_SLEEPDEEP_Msk;
+        __DSB();
+        __WFI();
+        interrupts();
+#elif defined(ARDUINO_ARCH_AVR)
+        set_sleep_mode(SLEEP_MODE_IDLE);
+        noInterrupts();
+        if (TActor::SignalPending) {
+            interrupts();
+            break;
+        }
+        sleep_enable();
+        interrupts(); // the instruction after sei is executed before any interrupt, so it's the sleep
+        sleep_cpu();
+        sleep_disable();
+#else
+        break;
+#endif
+    }
+}
+
 void TActorLib::Send(TActor* recipient, TEventPtr event) {
     recipient->Events.push_back(Move(event));
+    recipient->EventsChanged = true;
 }
 
 void TActorLib::SendImmediate(TActor* recipient, TEventPtr event) {
     recipient->Events.push_front(Move(event));
+    recipient->EventsChanged = true;
 }
 
 void TActorLib::SendSync(TActor* recipient, TEventPtr event) {
@@ -161,10 +326,12 @@ void TActorLib::SendSync(TActor* recipient, TEventPtr event) {
 
 void TActorLib::Resend(TActor* recipient, TEventPtr event) {
     recipient->Events.push_back(Move(event));
+    recipient->EventsChanged = true;
 }
 
 void TActorLib::ResendImmediate(TActor* recipient, TEventPtr event) {
     recipient->Events.push_front(Move(event));
+    recipient->EventsChanged = true;
 }
 
 void TActorLib::Sleep() {
@@ -257,6 +424,7 @@ void TActor::OnSend(TEventPtr event, const TActorContext& context) {
 }
 
 void TActor::PurgeEvents(TEventID eventId) {
+    EventsChanged = true;
     for (auto it = Events.begin(); it != Events.end(); ) {
         if (it.Get()->EventID == eventId) {
             it = Events.erase(it);
@@ -372,10 +540,6 @@ void EVSYS_Handler() {
     AW::Reset("EVSYS");
 }
 
-void ADC_Handler() {
-    AW::Reset("ADC");
-}
-
 void AC_Handler() {
     AW::Reset("AC");
 }
@@ -0,0 +1,100 @@
+// pio test -f test_bmx280: the integer compensation against the datasheet example and the exact decimal values
+// of the Bosch integer results, and its speed against the float conversion it replaced
+#include <Arduino.h>
+#include <unity.h>
+#include <aw.h>
+#include <SensorBMx280Compensation.h>
+
+using namespace AW;
+
+struct TCalib {
+    uint16_t dig_T1;
+    int16_t dig_T2;
+    int16_t dig_T3;
+    uint16_t dig_P1;
+    int16_t dig_P2;
+    int16_t dig_P3;
+    int16_t dig_P4;
+    int16_t dig_P5;
+    int16_t dig_P6;
+    int16_t dig_P7;
+    int16_t dig_P8;
+    int16_t dig_P9;
+    uint8_t dig_H1;
+    int16_t dig_H2;
+    uint8_t dig_H3;
+    int16_t dig_H4;
+    int16_t dig_H5;
+    int8_t dig_H6;
+};
+
+// BMP280 datasheet, 3.12 computation example, the humidity part is a typical BME280
+static const TCalib Calib = {27504, 26435, -1000, 36477, -10685, 3024, 2855, 140, -7, 15500, -14600, 6000, 75, 362, 0, 313, 50, 30};
+
+void test_datasheet_example() {
+    int32_t t_fine = TBMx280Compensation::GetTFine(Calib, 519888);
+    TEST_ASSERT_EQUAL_INT32(128422, t_fine);
+    TEST_ASSERT_EQUAL_INT32(25080, TBMx280Compensation::GetTemperature(t_fine).raw()); // 25.08 C
+    uint32_t pressure = TBMx280Compensation::GetPressureQ8(Calib, t_fine, 415148);
+    // the datasheet gives 100653.27 Pa from the floating point formula, the 64-bit integer one gives 25767233 / 256 = 100653.25 Pa
+    TEST_ASSERT_EQUAL_UINT32(25767233, pressure);
+    TEST_ASSERT_EQUAL_INT32(754961, TBMx280Compensation::GetPressureMmHg(pressure).raw()); // 754.961 mmHg
+}
+
+// the conversions are truncated as the exact quotients, no tolerance
+void test_exact_conversion() {
+    for (int32_t t_fine = -204800; t_fine <= 435200; t_fine += 13) { // -40..85 C
+        TEST_ASSERT_EQUAL_INT32(((t_fine * 5 + 128) >> 8) * 10, TBMx280Compensation::GetTemperature(t_fine).raw());
+    }
+    // 1/1000 mmHg = Pa / 256 * 1000 / 133.32239 = p * 10^8 / 3413053184, every pressure up to 131 kPa on the host,
+    // a stride on the board to keep the run short
+#ifdef ARDUINO
+    const uint32_t step = 997;
+#else
+    const uint32_t step = 1;
+#endif
+    for (uint32_t pressure = 0; pressure < (1UL << 25); pressure += step) {
+        uint32_t exact = (uint32_t)((uint64_t)pressure * 100000000ULL / 3413053184ULL);
+        TEST_ASSERT_EQUAL_UINT32(exact, (uint32_t)TBMx280Compensation::GetPressureMmHg(pressure).raw());
+    }
+    for (uint32_t humidity = 0; humidity <= (419430400UL >> 12); ++humidity) {
+        TEST_ASSERT_EQUAL_UINT32(humidity * 1000 / 1024, (uint32_t)TBMx280Compensation::GetHumidity(humidity).raw());
+    }
+}
+
+volatile int32_t Sink;
+
+void test_benchmark() {
+    const int count = 2000;
+    unsigned long start = micros();
+    for (int i = 0; i < count; ++i) {
+        uint32_t pressure = 24000000 + i * 97;
+        float p = (float)pressure / 256;
+        Sink = fixed3_t(p / 133.32239f).raw();
+        float t = (i * 5 + 128) >> 8;
+        Sink = fixed3_t(t / 100).raw();
+    }
+    unsigned long floatTime = micros() - start;
+    start = micros();
+    for (int i = 0; i < count; ++i) {
+        uint32_t pressure = 24000000 + i * 97;
+        Sink = TBMx280Compensation::GetPressureMmHg(pressure).raw();
+        Sink = TBMx280Compensation::GetTemperature(i).raw();
+    }
+    unsigned long integerTime = micros() - start;
+    char message[100];
+    snprintf(message, sizeof(message), "pressure + temperature conversion: float %lu ns, integer %lu ns",
+        floatTime * 1000 / count, integerTime * 1000 / count);
+    TEST_MESSAGE(message);
+}
+
+void setup() {
+    delay(2000); // the board needs time to bring up the serial for the test runner
+    UNITY_BEGIN();
+    RUN_TEST(test_datasheet_example);
+    RUN_TEST(test_exact_conversion);
+    RUN_TEST(test_benchmark);
+    UNITY_END();
+}
+
+void loop() {}
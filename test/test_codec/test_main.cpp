@@ -0,0 +1,138 @@
+// pio test -f test_codec: round trip of the series codec and its size and speed against the 16 byte log records
+#include <Arduino.h>
+#include <unity.h>
+#include <aw.h>
+
+using namespace AW;
+
+// 4 sensors reported together once a minute, slowly drifting values
+struct TSampleGenerator {
+    uint32_t Seed = 1;
+    uint32_t Time = 1000;
+    int32_t Values[4] = {21500, 745123, 12034, 512};
+    uint8_t Index = 0;
+
+    uint32_t Random() {
+        Seed = Seed * 1103515245u + 12345u;
+        return (Seed >> 16) & 0x7fff;
+    }
+
+    void Next(uint32_t& time, fixed3_t& value, uint16_t& id) {
+        if (Index == 0) {
+            Time += 60 + (Random() % 3 == 0 ? 1 : 0);
+            Values[0] += (int32_t)(Random() % 21) - 10;
+            Values[1] += (int32_t)(Random() % 101) - 50;
+            Values[2] += (int32_t)(Random() % 7) - 3;
+            Values[3] = 500 + Random() % 50;
+        }
+        time = Time;
+        value.raw(Values[Index]);
+        id = 0x1000 + Index * 0x1111;
+        Index = (Index + 1) % 4;
+    }
+};
+
+static constexpr size_t BlockSize = 64; // TDefaultEnvironment::DumpPackSize
+static constexpr int Samples = 2000;
+
+void test_round_trip() {
+    TSampleGenerator source;
+    TSampleGenerator check;
+    int count = 0;
+    while (count < Samples) {
+        uint8_t block[BlockSize];
+        TSeriesEncoder<> encoder(block, sizeof(block));
+        for (;;) {
+            uint32_t time;
+            fixed3_t value;
+            uint16_t id;
+            TSampleGenerator before = source;
+            source.Next(time, value, id);
+            if (count + encoder.GetCount() == Samples || !encoder.Append(time, value, id)) {
+                source = before;
+                break;
+            }
+        }
+        TEST_ASSERT_TRUE(encoder.GetCount() > 0);
+        TSeriesDecoder<> decoder(block, encoder.Finish());
+        uint32_t time;
+        fixed3_t value;
+        uint16_t id;
+        while (decoder.Next(time, value, id)) {
+            uint32_t expectedTime;
+            fixed3_t expectedValue;
+            uint16_t expectedId;
+            check.Next(expectedTime, expectedValue, expectedId);
+            TEST_ASSERT_EQUAL_UINT32(expectedTime, time);
+            TEST_ASSERT_EQUAL_INT32(expectedValue.raw(), value.raw());
+            TEST_ASSERT_EQUAL_UINT16(expectedId, id);
+            ++count;
+        }
+        TEST_ASSERT_EQUAL_UINT16(0, decoder.GetCount());
+    }
+    TEST_ASSERT_EQUAL_INT(Samples, count);
+}
+
+// the deltas wrap around, jumps over the whole int32 range and back must survive
+void test_extreme_deltas() {
+    static const int32_t values[] = {0, 2147483647, -2147483647 - 1, 2147483647, 0, -1, -2147483647 - 1};
+    static const uint32_t times[] = {0, 0xffffffffu, 0, 0x80000000u, 0x7fffffffu, 1, 0xfffffff0u};
+    uint8_t block[128];
+    TSeriesEncoder<> encoder(block, sizeof(block));
+    for (size_t i = 0; i < sizeof(values) / sizeof(values[0]); ++i) {
+        fixed3_t value;
+        value.raw(values[i]);
+        TEST_ASSERT_TRUE(encoder.Append(times[i], value));
+    }
+    TSeriesDecoder<> decoder(block, encoder.Finish());
+    for (size_t i = 0; i < sizeof(values) / sizeof(values[0]); ++i) {
+        uint32_t time;
+        fixed3_t value;
+        TEST_ASSERT_TRUE(decoder.Next(time, value));
+        TEST_ASSERT_EQUAL_UINT32(times[i], time);
+        TEST_ASSERT_EQUAL_INT32(values[i], value.raw());
+    }
+}
+
+void test_benchmark() {
+    TSampleGenerator source;
+    size_t bytes = 0;
+    int count = 0;
+    unsigned long elapsed = 0;
+    while (count < Samples) {
+        uint8_t block[BlockSize];
+        TSeriesEncoder<> encoder(block, sizeof(block));
+        for (;;) {
+            uint32_t time;
+            fixed3_t value;
+            uint16_t id;
+            TSampleGenerator before = source;
+            source.Next(time, value, id);
+            unsigned long start = micros();
+            bool appended = count + encoder.GetCount() < Samples && encoder.Append(time, value, id);
+            elapsed += micros() - start;
+            if (!appended) {
+                source = before;
+                break;
+            }
+        }
+        count += encoder.GetCount();
+        bytes += encoder.Finish();
+    }
+    char message[100];
+    snprintf(message, sizeof(message), "%d samples: %u bytes, %u.%02u bytes/sample (16 raw), %lu ns/sample",
+        count, (unsigned)bytes, (unsigned)(bytes / count), (unsigned)(bytes * 100 / count % 100), elapsed * 1000 / count);
+    TEST_MESSAGE(message);
+    TEST_ASSERT_TRUE(bytes * 2 < (size_t)count * 16); // at least 2x smaller than the log records, with the block headers
+}
+
+void setup() {
+    delay(2000); // the board needs time to bring up the serial for the test runner
+    UNITY_BEGIN();
+    RUN_TEST(test_round_trip);
+    RUN_TEST(test_extreme_deltas);
+    RUN_TEST(test_benchmark);
+    UNITY_END();
+}
+
+void loop() {}
@@ -0,0 +1,86 @@
+// pio test -f test_datalog: the data log on the double-banked flash array, its write amplification and throughput
+#include <Arduino.h>
+#include <unity.h>
+#include <aw.h>
+#include <aw-storage.h>
+#include <aw-log.h>
+
+using namespace AW;
+
+using TFlash = TRAMFlash<4096>;
+using TArray = TFlashByteArray<TFlash, 1024>;
+using TCached = TCachedByteArray<TArray>;
+using TLog = TDataLog<TCached>;
+
+static TFlash Flash; // too big for the stack of the test
+
+static void EraseFlash() {
+    for (size_t row = 0; row < TFlash::size(); row += TFlash::RowSize) {
+        Flash.EraseRow(row);
+    }
+    Flash.Erases = 0;
+    Flash.Writes = 0;
+}
+
+void test_remount() {
+    EraseFlash();
+    {
+        TArray array(Flash);
+        TCached cached(array);
+        TLog log(cached);
+        TEST_ASSERT_EQUAL_INT(64, log.capacity());
+        for (int i = 0; i < 100; ++i) {
+            log.Append(TTime::Seconds(i * 10), "bme", "temp", fixed3_t(i));
+        }
+        log.Sync();
+    }
+    TArray array(Flash);
+    TCached cached(array);
+    TLog log(cached);
+    TEST_ASSERT_EQUAL_INT(64, log.size());
+    TLogRecord record;
+    TEST_ASSERT_TRUE(log.Read(0, record));
+    TEST_ASSERT_EQUAL_UINT32(360, record.Time);
+    TEST_ASSERT_EQUAL_INT32(fixed3_t(36).raw(), record.Value);
+    TEST_ASSERT_EQUAL_UINT16(TLog::GetId("bme", "temp"), record.Id);
+    TEST_ASSERT_EQUAL_INT(44, log.Find(800));
+    // the log clock continues after the last record
+    TEST_ASSERT_EQUAL_UINT32(991, log.GetTime(TTime()));
+}
+
+// every Sync() rewrites the whole bank: 1024 bytes of data and the footer take 5 rows of 256 bytes,
+// synced every 64 records (1024 bytes) it is 1280 flash bytes per 1024 logged, 1.25x
+void test_write_amplification() {
+    static constexpr int Records = 6400;
+    static constexpr int SyncEvery = 64;
+    EraseFlash();
+    TArray array(Flash);
+    TCached cached(array);
+    TLog log(cached);
+    unsigned long start = micros();
+    for (int i = 0; i < Records; ++i) {
+        log.Append(TTime::Seconds(i), 0x1234, fixed3_t(i));
+        if (i % SyncEvery == SyncEvery - 1) {
+            log.Sync();
+        }
+    }
+    unsigned long elapsed = micros() - start;
+    unsigned long logged = (unsigned long)Records * TLog::RecordSize;
+    unsigned long written = Flash.Writes * TFlash::PageSize;
+    char message[120];
+    snprintf(message, sizeof(message), "%d records: %lu ns/record, %lu bytes logged, %lu flash bytes written (%lu.%02lux), %lu row erases",
+        Records, elapsed * 1000 / Records, logged, written, written / logged, written * 100 / logged % 100, Flash.Erases);
+    TEST_MESSAGE(message);
+    TEST_ASSERT_EQUAL_UINT32(Records / SyncEvery * 5, Flash.Erases);
+    TEST_ASSERT_EQUAL_UINT32(logged * 125 / 100, written);
+}
+
+void setup() {
+    delay(2000); // the board needs time to bring up the serial for the test runner
+    UNITY_BEGIN();
+    RUN_TEST(test_remount);
+    RUN_TEST(test_write_amplification);
+    UNITY_END();
+}
+
+void loop() {}
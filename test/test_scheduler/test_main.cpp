@@ -0,0 +1,153 @@
+// pio test -f test_scheduler: the order of the due events, and the latency of a command against the busy sensors
+#include <Arduino.h>
+#include <unity.h>
+#include <Adafruit_SleepyDog.h>
+#include <aw.h>
+
+using namespace AW;
+
+// records the order of the handled events by their NotBefore, as milliseconds
+struct TRecorder : TActor {
+    unsigned long Order[8];
+    uint8_t Count = 0;
+
+    void OnEvent(TEventPtr event, const TActorContext&) override {
+        if (event->EventID == TEventData::EventID && Count < 8) {
+            Order[Count++] = event->NotBefore.MilliSeconds();
+        }
+    }
+};
+
+static void SendAt(TActorLib& lib, TActor* recipient, TTime notBefore, EEventPriority priority = EEventPriority::Normal) {
+    TEventPtr event = new TEventData("x");
+    event->NotBefore = notBefore;
+    event->Priority = priority;
+    lib.Send(recipient, Move(event));
+}
+
+void test_due_order() {
+    TActorLib lib;
+    TRecorder first;
+    TRecorder second;
+    ++lib.StandbyLocks; // idles instead of the standby, which would stop the USB of the test runner
+    lib.Register(&first);
+    lib.Register(&second);
+    lib.Run();
+    TTime now = TTime::Now() + lib.SleepTime;
+    SendAt(lib, &second, now - TTime::MilliSeconds(3));
+    SendAt(lib, &first, now - TTime::MilliSeconds(1));
+    SendAt(lib, &first, now - TTime::MilliSeconds(2), EEventPriority::Low);
+    SendAt(lib, &second, now - TTime::MilliSeconds(4), EEventPriority::High);
+    SendAt(lib, &first, now + TTime::MilliSeconds(50));
+    SendAt(lib, &second, now + TTime::MilliSeconds(40));
+    lib.Run();
+    TEST_ASSERT_EQUAL_INT(2, first.Count);
+    TEST_ASSERT_EQUAL_INT(2, second.Count);
+    // by the class, then by NotBefore across the actors: high, normal -3, normal -1, low
+    TEST_ASSERT_EQUAL_UINT32((now - TTime::MilliSeconds(4)).MilliSeconds(), second.Order[0]);
+    TEST_ASSERT_EQUAL_UINT32((now - TTime::MilliSeconds(3)).MilliSeconds(), second.Order[1]);
+    TEST_ASSERT_EQUAL_UINT32((now - TTime::MilliSeconds(1)).MilliSeconds(), first.Order[0]);
+    TEST_ASSERT_EQUAL_UINT32((now - TTime::MilliSeconds(2)).MilliSeconds(), first.Order[1]);
+    // the events which were not due come in their time, earlier than the cached scan of the other actor
+    while (second.Count == 2 || first.Count == 2) {
+        lib.Run();
+    }
+    TEST_ASSERT_EQUAL_UINT32((now + TTime::MilliSeconds(40)).MilliSeconds(), second.Order[2]);
+    TEST_ASSERT_EQUAL_UINT32((now + TTime::MilliSeconds(50)).MilliSeconds(), first.Order[2]);
+    // a purged event is not run from the last scan
+    SendAt(lib, &first, now);
+    first.PurgeEvents(TEventData::EventID);
+    lib.Run();
+    TEST_ASSERT_EQUAL_INT(3, first.Count);
+}
+
+static constexpr unsigned long SensorWork = 8000; // us, one measurement of a slow sensor
+static constexpr unsigned long CommandPeriod = 37000; // us, the commands come in the middle of the measurements
+
+struct TCommandActor;
+static TActorLib* Lib;
+static TCommandActor* Commands;
+static unsigned long NextCommand;
+
+static void Busy(unsigned long us);
+
+struct TSlowSensor : TActor {
+    void OnEvent(TEventPtr event, const TActorContext& context) override {
+        if (event->EventID == TEventBootstrap::EventID) {
+            context.Send(this, this, new TEventReceive());
+            return;
+        }
+        Busy(SensorWork);
+        event->NotBefore = context.Now + TTime::MilliSeconds(50);
+        context.Resend(this, event.Release());
+    }
+};
+
+struct TCommandActor : TActor {
+    unsigned long MaxLatency = 0;
+    unsigned long SumLatency = 0;
+    unsigned long Count = 0;
+
+    void OnEvent(TEventPtr event, const TActorContext&) override {
+        if (event->EventID != TEventData::EventID) {
+            return;
+        }
+        unsigned long latency = micros() - static_cast<TEventData*>(event.Get())->Data.toulong();
+        if (MaxLatency < latency) {
+            MaxLatency = latency;
+        }
+        SumLatency += latency;
+        ++Count;
+    }
+};
+
+// the command is received in the middle of the work, like from the UART interrupt
+static void Busy(unsigned long us) {
+    unsigned long start = micros();
+    while (micros() - start < us) {
+        if ((long)(micros() - NextCommand) >= 0) {
+            NextCommand = micros() + CommandPeriod;
+            TEventPtr event = new TEventData(AW::String((unsigned long)micros()));
+            event->NotBefore = TTime::Now() + Lib->SleepTime;
+            event->Priority = EEventPriority::High;
+            Lib->Send(Commands, Move(event));
+        }
+    }
+}
+
+// 6 sensors take ~96% of the CPU, a command should wait only for the measurement which is running
+void test_command_latency() {
+    TActorLib lib;
+    TSlowSensor sensors[6];
+    TCommandActor commands;
+    Lib = &lib;
+    Commands = &commands;
+    NextCommand = micros();
+    ++lib.StandbyLocks;
+    for (TSlowSensor& sensor : sensors) {
+        lib.Register(&sensor);
+    }
+    lib.Register(&commands);
+    unsigned long start = millis();
+    while (millis() - start < 5000) {
+        lib.Run();
+    }
+    char message[100];
+    snprintf(message, sizeof(message), "%lu commands: latency avg %lu us, max %lu us, sensors busy %lu%%",
+        commands.Count, commands.SumLatency / commands.Count, commands.MaxLatency, lib.BusyTime.MilliSeconds() * 100 / 5000);
+    TEST_MESSAGE(message);
+    TEST_ASSERT_TRUE(commands.Count > 100);
+    TEST_ASSERT_TRUE(commands.MaxLatency < SensorWork + 2000);
+    TEST_ASSERT_TRUE(lib.MaxLatency[(uint8_t)EEventPriority::High].MilliSeconds() <= (SensorWork + 2000) / 1000);
+}
+
+void setup() {
+    delay(2000); // the board needs time to bring up the serial for the test runner
+    UNITY_BEGIN();
+    RUN_TEST(test_due_order);
+    RUN_TEST(test_command_latency);
+    UNITY_END();
+    Watchdog.disable(); // TActorLib enabled it, loop() doesn't reset it
+}
+
+void loop() {}
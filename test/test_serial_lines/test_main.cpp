@@ -0,0 +1,193 @@
+// pio test -f test_serial_lines: the lines of TSerialActor, intact and owned by the events, and the CPU they take at 115200 baud
+#include <Arduino.h>
+#include <unity.h>
+#include <aw.h>
+#include <aw-serial.h>
+
+using namespace AW;
+
+// the port the test fills, like the core receive buffer filled in the UART interrupt
+struct TFakeSerial {
+    static char Input[512];
+    static unsigned int Available;
+
+    static void Begin() {}
+    static int AvailableForRead() { return (int)Available; }
+    static int AvailableForWrite() { return 0; }
+    static int Write(const char*, int) { return 0; }
+    static void Flush() {}
+    static void SkipAll() { Available = 0; }
+    static constexpr long GetBaud() { return 115200; }
+    static constexpr unsigned int GetReceiveBufferSize() { return 64; }
+
+    static int Read(char* buffer, int length) {
+        memcpy(buffer, Input, length);
+        Available -= length;
+        memmove(Input, Input + length, Available);
+        return length;
+    }
+
+    static void Put(const char* data, unsigned int size) {
+        memcpy(Input + Available, data, size);
+        Available += size;
+    }
+};
+
+char TFakeSerial::Input[512];
+unsigned int TFakeSerial::Available = 0;
+
+struct TSerial : TSerialActor<TFakeSerial> {
+    using TSerialActor::TSerialActor;
+
+    // one poll of the port, without the lib and its timing
+    void Poll(const TActorContext& context) {
+        OnReceive(new TEventReceive(), context);
+        Events.pop_front();
+    }
+};
+
+static uint32_t LineHash(uint32_t hash, const char* data, size_t size) {
+    for (size_t i = 0; i < size; ++i) {
+        hash = (hash ^ (uint8_t)data[i]) * 16777619u;
+    }
+    return hash;
+}
+
+static constexpr uint32_t HashStart = 2166136261u;
+
+// hashes the received lines, keeps some of the events for a while and checks they didn't change in the meantime
+struct TOwner : TActor {
+    static constexpr int Slots = 4;
+    TEventPtr Held[Slots];
+    uint32_t HeldHash[Slots];
+    uint32_t Hash = HashStart;
+    unsigned long Lines = 0;
+    unsigned long Changed = 0;
+    bool Hold = false;
+
+    void OnEvent(TEventPtr event, const TActorContext&) override {
+        if (event->EventID != TEventData::EventID) {
+            return;
+        }
+        const AW::String& data = static_cast<TEventData*>(event.Get())->Data;
+        Hash = LineHash(LineHash(Hash, data.data(), data.size()), "|", 1);
+        ++Lines;
+        if (Hold) {
+            int slot = Lines % Slots;
+            Release(slot);
+            HeldHash[slot] = LineHash(HashStart, data.data(), data.size());
+            Held[slot] = Move(event);
+        }
+    }
+
+    void Release(int slot) {
+        if (Held[slot].Get() != nullptr) {
+            const AW::String& data = static_cast<TEventData*>(Held[slot].Get())->Data;
+            if (LineHash(HashStart, data.data(), data.size()) != HeldHash[slot]) {
+                ++Changed;
+            }
+            Held[slot] = nullptr;
+        }
+    }
+
+    void Deliver(const TActorContext& context) {
+        while (!Events.empty()) {
+            auto it = Events.begin();
+            OnEvent(Events.pop_value(it), context);
+        }
+    }
+};
+
+// random lines (one of them longer than the buffer) in random chunks, the consumer holding some of the lines
+void test_lines() {
+    TActorLib lib;
+    TActorContext context(lib);
+    TOwner owner;
+    TSerial serial(&owner);
+    TFakeSerial::Available = 0;
+    randomSeed(1);
+    uint32_t expected = HashStart;
+    char line[320];
+    for (int i = 0; i < 1000; ++i) {
+        unsigned int size = i == 500 ? 300 : random(127);
+        for (unsigned int j = 0; j < size; ++j) {
+            line[j] = 'a' + random(26);
+        }
+        // the lines over the buffer are cut at MaxBufferSize, CR before LF is dropped
+        unsigned int rest = 0;
+        for (; size - rest >= TSerial::MaxBufferSize; rest += TSerial::MaxBufferSize) {
+            expected = LineHash(LineHash(expected, line + rest, TSerial::MaxBufferSize), "|", 1);
+        }
+        expected = LineHash(LineHash(expected, line + rest, size - rest), "|", 1);
+        if (random(4) == 0) {
+            line[size++] = '\r';
+        }
+        line[size++] = '\n';
+        for (unsigned int sent = 0; sent < size;) {
+            unsigned int chunk = min((unsigned int)random(1, 65), size - sent);
+            TFakeSerial::Put(line + sent, chunk);
+            sent += chunk;
+            // a poll reads only up to the end of the line buffer
+            while (TFakeSerial::Available != 0) {
+                owner.Hold = random(3) == 0;
+                serial.Poll(context);
+                owner.Deliver(context);
+                if (random(2) == 0) {
+                    owner.Release(random(TOwner::Slots));
+                }
+            }
+        }
+    }
+    for (int slot = 0; slot < TOwner::Slots; ++slot) {
+        owner.Release(slot);
+    }
+    TEST_ASSERT_EQUAL_UINT32(0, TFakeSerial::Available);
+    TEST_ASSERT_EQUAL_UINT32(1002, owner.Lines);
+    TEST_ASSERT_EQUAL_UINT32(expected, owner.Hash);
+    TEST_ASSERT_EQUAL_UINT32(0, owner.Changed);
+}
+
+// 41-byte commands in 64-byte chunks (the core buffer), the share of the CPU the lines take at 115200 baud (11520 bytes/s)
+void test_throughput() {
+    static constexpr unsigned long Bytes = 64UL * 1024;
+    static const char Line[] = "READ 0123456789 abcdefghij 0123456789ab\r\n";
+    static constexpr unsigned int LineSize = sizeof(Line) - 1;
+    TActorLib lib;
+    TActorContext context(lib);
+    TOwner owner;
+    TSerial serial(&owner);
+    TFakeSerial::Available = 0;
+    char chunk[64];
+    unsigned int offset = 0;
+    unsigned long start = micros();
+    for (unsigned long sent = 0; sent < Bytes; sent += sizeof(chunk)) {
+        for (char& c : chunk) {
+            c = Line[offset];
+            offset = (offset + 1) % LineSize;
+        }
+        TFakeSerial::Put(chunk, sizeof(chunk));
+        while (TFakeSerial::Available != 0) {
+            serial.Poll(context);
+            owner.Deliver(context);
+        }
+    }
+    unsigned long elapsed = micros() - start;
+    unsigned long nsPerByte = elapsed * 1000 / Bytes;
+    unsigned long share = nsPerByte * 11520 / 100000; // in 1/10000 of the CPU
+    char message[100];
+    snprintf(message, sizeof(message), "%lu lines: %lu ns/byte, %lu.%02lu%% of the CPU at 115200 baud",
+        owner.Lines, nsPerByte, share / 100, share % 100);
+    TEST_MESSAGE(message);
+    TEST_ASSERT_EQUAL_UINT32(Bytes / LineSize, owner.Lines);
+    TEST_ASSERT_TRUE(share < 1000);
+}
+
+void setup() {
+    delay(2000); // the board needs time to bring up the serial for the test runner
+    UNITY_BEGIN();
+    RUN_TEST(test_lines);
+    RUN_TEST(test_throughput);
+    UNITY_END();
+}
+
+void loop() {}